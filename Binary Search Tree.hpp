@@ -4,6 +4,12 @@
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "node_pool.hpp"
 
 
 template <typename T>
@@ -11,144 +17,879 @@ class TreeNode
 {
     public:
         T element;
-        std::unique_ptr<TreeNode<T>> left;
-        std::unique_ptr<TreeNode<T>> right;
+        TreeNode<T>* left;
+        TreeNode<T>* right;
+        TreeNode<T>* parent;
+        // number of nodes in this subtree, this one included
+        size_t size;
+        // heap key of the Treap policy, unused otherwise
+        uint32_t priority;
 
         TreeNode<T>(const T& e)
-            :element{e}, left{nullptr}, right{nullptr} {}
+            :element{e}, left{nullptr}, right{nullptr}, parent{nullptr}, size{1}, priority{0} {}
 
         ~TreeNode() {}
 
+        static size_t size_of(TreeNode<T>* t) {
+            return t != nullptr ? t->size : 0;
+        }
+
+        void update_size() {
+            size = size_of(left) + size_of(right) + 1;
+        }
+
+        // rotate the right child of *link up into its place
+        static void rotate_left(TreeNode<T>** link) {
+            TreeNode<T>* t = *link;
+            TreeNode<T>* r = t->right;
+            t->right = r->left;
+            if(t->right != nullptr){
+                t->right->parent = t;
+            }
+            r->left = t;
+            r->parent = t->parent;
+            t->parent = r;
+            t->update_size();
+            r->update_size();
+            *link = r;
+        }
+
+        // rotate the left child of *link up into its place
+        static void rotate_right(TreeNode<T>** link) {
+            TreeNode<T>* t = *link;
+            TreeNode<T>* l = t->left;
+            t->left = l->right;
+            if(t->left != nullptr){
+                t->left->parent = t;
+            }
+            l->right = t;
+            l->parent = t->parent;
+            t->parent = l;
+            t->update_size();
+            l->update_size();
+            *link = l;
+        }
+
+        static TreeNode<T>* leftmost(TreeNode<T>* t) {
+            while(t->left != nullptr){
+                t = t->left;
+            }
+            return t;
+        }
+
+        static TreeNode<T>* rightmost(TreeNode<T>* t) {
+            while(t->right != nullptr){
+                t = t->right;
+            }
+            return t;
+        }
+
+        // in-order successor, or nullptr after the last node
+        static TreeNode<T>* next(TreeNode<T>* t) {
+            if(t->right != nullptr){
+                return leftmost(t->right);
+            }
+            while(t->parent != nullptr && t->parent->right == t){
+                t = t->parent;
+            }
+            return t->parent;
+        }
+
+        // in-order predecessor, or nullptr before the first node
+        static TreeNode<T>* prev(TreeNode<T>* t) {
+            if(t->left != nullptr){
+                return rightmost(t->left);
+            }
+            while(t->parent != nullptr && t->parent->left == t){
+                t = t->parent;
+            }
+            return t->parent;
+        }
+
 };
 
 
-template <typename T>
+/*
+ * Balancing policies for BST. After every insert or remove, BST walks
+ * back up the search path and hands each ancestor's link to
+ * rebalance(), bottom-up, once the ancestor's size is up to date.
+ */
+
+// plain BST: the shape depends on the insert order
+struct NoBalance
+{
+    static constexpr bool rotate_down_on_remove = false;
+
+    template <typename Node>
+    static void init(Node*) {}
+
+    template <typename Node>
+    static void init_bulk(Node*, size_t, size_t) {}
+
+    template <typename Node>
+    static void rebalance(Node**) {}
+};
+
+/*
+ * Treap: every node draws a random priority and the tree is kept a
+ * max-heap on priorities, which makes its shape that of a BST built in
+ * random order whatever the real order was. Expected depth is O(log n)
+ * for every input; only unlucky priority draws, not key order, can make
+ * it deeper. A removed node is rotated down to a leaf so that the
+ * remaining priorities stay where the heap order wants them.
+ */
+struct Treap
+{
+    static constexpr bool rotate_down_on_remove = true;
+
+    static uint32_t random() {
+        // xorshift64*
+        static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL;
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return (state * 0x2545F4914F6CDD1DULL) >> 32;
+    }
+
+    template <typename Node>
+    static void init(Node* t) {
+        t->priority = random();
+    }
+
+    /* For a tree built bottom-up the shape is given, so the priorities
+     * only have to respect it: the high bits hold the level, counted up
+     * from the leaves, and the low bits are random. */
+    template <typename Node>
+    static void init_bulk(Node* t, size_t depth, size_t height) {
+        unsigned bits = 1;
+        while((size_t(1) << bits) < height){
+            bits++;
+        }
+        t->priority = (uint32_t(height - 1 - depth) << (32 - bits)) | (random() >> bits);
+    }
+
+    template <typename Node>
+    static void rebalance(Node** link) {
+        Node* t = *link;
+        if(t->left != nullptr && t->left->priority > t->priority){
+            Node::rotate_right(link);
+        }
+        else if(t->right != nullptr && t->right->priority > t->priority){
+            Node::rotate_left(link);
+        }
+    }
+};
+
+/*
+ * Weight-balanced tree (BB[alpha]) with the parameters of Hirai and
+ * Yamamoto: with weight = size + 1, neither subtree may weigh more than
+ * DELTA times the other, and a single or double rotation on the way
+ * back up restores that after any insert or remove. Depth is at most
+ * about 2.7 log2(n) in the worst case.
+ */
+struct WeightBalance
+{
+    static constexpr bool rotate_down_on_remove = false;
+    static constexpr size_t DELTA = 3;
+    static constexpr size_t GAMMA = 2;
+
+    template <typename Node>
+    static void init(Node*) {}
+
+    // a perfectly balanced tree is weight-balanced as it stands
+    template <typename Node>
+    static void init_bulk(Node*, size_t, size_t) {}
+
+    template <typename Node>
+    static void rebalance(Node** link) {
+        Node* t = *link;
+        size_t wl = Node::size_of(t->left) + 1;
+        size_t wr = Node::size_of(t->right) + 1;
+        if(wr > DELTA * wl){
+            Node* r = t->right;
+            if(Node::size_of(r->left) + 1 >= GAMMA * (Node::size_of(r->right) + 1)){
+                Node::rotate_right(&t->right);
+            }
+            Node::rotate_left(link);
+        }
+        else if(wl > DELTA * wr){
+            Node* l = t->left;
+            if(Node::size_of(l->right) + 1 >= GAMMA * (Node::size_of(l->left) + 1)){
+                Node::rotate_left(&t->left);
+            }
+            Node::rotate_right(link);
+        }
+    }
+};
+
+
+/*
+ * Nodes come from a NodePool owned by the tree, and every operation is a
+ * loop over the links rather than a recursion, so neither a degenerate
+ * (e.g. sorted) insert order nor destroying a deep tree can overflow the
+ * stack.
+ *
+ * `Balance' is one of NoBalance (the default), Treap or WeightBalance.
+ */
+template <typename T, typename Balance = NoBalance>
 class BST
 {
     public:
-        std::unique_ptr<TreeNode<T>> root = nullptr;
+        TreeNode<T>* root = nullptr;
 
-        ~BST() {}
+        BST() {}
+        ~BST() { clear(); }
 
         bool insert(const T& key);
         bool search(const T& key);
         bool remove(const T& key);
 
+        // remove every key and give all node memory back at once
+        void clear();
+
+        /*
+         * Replace the contents with the keys of [first, last), which must
+         * be sorted and free of duplicates. The result has minimum
+         * height. It takes O(n) time and one allocation for all the
+         * nodes, which then sit in key order in memory.
+         */
+        template <typename It>
+        void build_from_sorted(It first, It last);
+
+        // every key in order, without recursion, in O(n)
+        std::vector<T> to_sorted_vector();
+
+        /*
+         * Copy the keys into an implicit array in Eytzinger (BFS) order
+         * and answer search() from it until the next insert, remove or
+         * clear. The array search has no data-dependent branch and
+         * prefetches four levels ahead, so it overlaps the cache misses
+         * that the pointer search takes one level at a time.
+         */
+        void freeze();
+        bool is_frozen();
+
+        size_t get_size();
+
+        /*
+         * Order statistics, from the subtree sizes: O(depth) each, so
+         * O(log n) with a balancing policy.
+         */
+        // k-th smallest key (0-based), or nullptr if k >= get_size()
+        const T* select(size_t k);
+        // number of keys smaller than key
+        size_t rank(const T& key);
+        // number of keys in [lo, hi]
+        size_t count_range(const T& lo, const T& hi);
+
+        /*
+         * Walks the keys in [lo, hi] in order, one node at a time. It
+         * keeps the stack of ancestors still to visit, so it is set up in
+         * O(depth) and each step costs amortized O(1). Any insert or
+         * remove invalidates it.
+         */
+        class RangeIterator
+        {
+            public:
+                RangeIterator() {}
+                RangeIterator(TreeNode<T>* root, const T& lo, const T& hi);
+
+                const T& operator*() const { return stack.back()->element; }
+                const T* operator->() const { return &stack.back()->element; }
+                RangeIterator& operator++();
+
+                bool operator==(const RangeIterator& other) const {
+                    return stack.empty() ? other.stack.empty()
+                        : !other.stack.empty() && stack.back() == other.stack.back();
+                }
+                bool operator!=(const RangeIterator& other) const { return !(*this == other); }
+
+            private:
+                std::vector<TreeNode<T>*> stack;
+                // a copy, so that ranges over temporaries are safe
+                std::optional<T> hi;
+
+                // push t and its chain of left children
+                void push_left(TreeNode<T>* t);
+                // stop once the next key is past hi
+                void check_end();
+        };
+
+        // for(const T& key : tree.range(lo, hi))
+        struct Range
+        {
+            RangeIterator first;
+            RangeIterator begin() { return first; }
+            RangeIterator end() { return RangeIterator(); }
+        };
+
+        Range range(const T& lo, const T& hi);
+
+        /*
+         * Bidirectional in-order iterator. It holds just a node and
+         * steps through the parent links, so it needs no stack and
+         * stays valid across inserts. A remove invalidates every
+         * iterator, since it may move a key into another node.
+         * Decrementing end() gives the largest key.
+         */
+        class Iterator
+        {
+            public:
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef T value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const T* pointer;
+                typedef const T& reference;
+
+                Iterator() {}
+
+                const T& operator*() const { return node->element; }
+                const T* operator->() const { return &node->element; }
+
+                Iterator& operator++() {
+                    node = TreeNode<T>::next(node);
+                    return *this;
+                }
+                Iterator& operator--() {
+                    node = node != nullptr ? TreeNode<T>::prev(node)
+                                           : TreeNode<T>::rightmost(tree->root);
+                    return *this;
+                }
+                Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+                Iterator operator--(int) { Iterator it = *this; --*this; return it; }
+
+                bool operator==(const Iterator& other) const { return node == other.node; }
+                bool operator!=(const Iterator& other) const { return node != other.node; }
+
+            private:
+                friend class BST;
+                Iterator(TreeNode<T>* node, const BST* tree) : node{node}, tree{tree} {}
+
+                TreeNode<T>* node = nullptr;
+                const BST* tree = nullptr;
+        };
+
+        Iterator begin();
+        Iterator end();
+
+        // key's position, or end()
+        Iterator find(const T& key);
+        // first key >= key, or end()
+        Iterator lower_bound(const T& key);
+        // first key > key, or end()
+        Iterator upper_bound(const T& key);
+
+        /*
+         * Finger search: the same lookups, started from a previous
+         * position instead of the root. The search climbs from the
+         * finger only until its subtree spans key, then descends, so it
+         * costs O(depth of the finger's and the result's lowest common
+         * ancestor) rather than O(depth of the tree). With the Treap
+         * policy that is expected O(log d) for keys d positions apart;
+         * for the other policies it is O(log d) amortized over a sorted
+         * batch of lookups that passes each result on as the next
+         * finger. end() as a finger means the root.
+         */
+        Iterator find(const T& key, Iterator finger);
+        Iterator lower_bound(const T& key, Iterator finger);
+        Iterator upper_bound(const T& key, Iterator finger);
+
     private:
-        bool insert(std::unique_ptr<TreeNode<T>>& t, const T& key);
-        bool search(std::unique_ptr<TreeNode<T>>& t, const T& key);
-        bool remove(std::unique_ptr<TreeNode<T>>& t, const T& key);
+        NodePool<TreeNode<T>> pool;
+
+        // links to the ancestors of the node being changed, root first;
+        // kept as a member so that its storage is reused
+        std::vector<TreeNode<T>**> path;
+
+        // link that points to key's node, or to the null link where it
+        // would go; the links above it are left in path
+        TreeNode<T>** find_link(const T& key);
+
+        // add delta to the size of every node on path and rebalance them,
+        // deepest first
+        void fix_path(int delta);
+
+        // first node, searching from finger (or the root if it is null),
+        // whose element is not before(element); nullptr if none is
+        template <typename Before>
+        TreeNode<T>* first_not_before(TreeNode<T>* finger, Before before);
+
+        // keys in Eytzinger order, from index 1; see freeze()
+        std::vector<T> frozen;
+        bool frozen_valid = false;
+
+        bool search_frozen(const T& key);
+        // drop the frozen copy after a mutation
+        void thaw();
 
-        T find_rightmost_key(std::unique_ptr<TreeNode<T>>& t);
+        // disallow copy and assignment
+        BST(const BST&);
+        BST& operator=(const BST&);
 };
 
-template <typename T>
-bool BST<T>::insert(const T& key) {
-    return insert(root, key);
+template <typename T, typename Balance>
+TreeNode<T>** BST<T, Balance>::find_link(const T& key) {
+    TreeNode<T>** t = &root;
+    path.clear();
+    while(*t != nullptr && !((*t)->element == key)){
+        path.push_back(t);
+        if(key > (*t)->element){
+            t = &(*t)->right;
+        }
+        else{
+            t = &(*t)->left;
+        }
+    }
+    return t;
 }
 
-template <typename T>
-bool BST<T>::search(const T& key) {
-    return search(root, key);
+template <typename T, typename Balance>
+void BST<T, Balance>::fix_path(int delta) {
+    for(size_t i = path.size(); i-- > 0; ){
+        (*path[i])->size += delta;
+        Balance::rebalance(path[i]);
+    }
 }
 
-template <typename T>
-bool BST<T>::remove(const T& key) {
-    return remove(root, key);
+template <typename T, typename Balance>
+bool BST<T, Balance>::insert(const T& key) {
+    // if insertion fails (i.e. if the key already exists in tree), return false
+    // otherwise, return true
+    TreeNode<T>** t = find_link(key);
+    if(*t != nullptr){
+        return false;
+    }
+    *t = pool.create(key);
+    (*t)->parent = path.empty() ? nullptr : *path.back();
+    Balance::init(*t);
+    fix_path(1);
+    thaw();
+    return true;
 }
 
-template <typename T>
-bool BST<T>::insert(std::unique_ptr<TreeNode<T>>& t, const T& key) {
+template <typename T, typename Balance>
+bool BST<T, Balance>::search(const T& key) {
+    // if key exists in tree, return true
+    // otherwise, return false
+    if(frozen_valid){
+        return search_frozen(key);
+    }
+    TreeNode<T>* t = root;
+    while(t != nullptr){
+        if(t->element == key){
+            return true;
+        }
+        else if(t->element > key){
+            t = t->left;
+        }
+        else{
+            t = t->right;
+        }
+    }
+    return false;
+}
 
-    // TODO
-    // if insertion fails (i.e. if the key already exists in tree), return false
+template <typename T, typename Balance>
+bool BST<T, Balance>::remove(const T& key) {
+    // if key does not exist in tree, return false
     // otherwise, return true
-    if(t == nullptr){
-        t = std::make_unique<TreeNode<T>>(key);
-        return true;
-    }
-    else if(t->element == key){
+    TreeNode<T>** t = find_link(key);
+    if(*t == nullptr){
         return false;
     }
-    else{
-        if(key > t -> element){
-            return insert(t -> right, key);
+
+    TreeNode<T>* node = *t;
+    if(node->left != nullptr && node->right != nullptr){
+        if(Balance::rotate_down_on_remove){
+            // rotate the node down below its higher-priority child until
+            // it has at most one child
+            while(node->left != nullptr && node->right != nullptr){
+                path.push_back(t);
+                if(node->left->priority > node->right->priority){
+                    TreeNode<T>::rotate_right(t);
+                    t = &(*t)->right;
+                }
+                else{
+                    TreeNode<T>::rotate_left(t);
+                    t = &(*t)->left;
+                }
+            }
         }
         else{
-            return insert(t -> left, key);
+            // take over the rightmost key of the left subtree, then unlink
+            // that node instead; it has no right child
+            path.push_back(t);
+            TreeNode<T>** m = &node->left;
+            while((*m)->right != nullptr){
+                path.push_back(m);
+                m = &(*m)->right;
+            }
+            node->element = std::move((*m)->element);
+            t = m;
+            node = *m;
         }
     }
+    TreeNode<T>* child = node->left != nullptr ? node->left : node->right;
+    *t = child;
+    if(child != nullptr){
+        child->parent = node->parent;
+    }
+    pool.destroy(node);
+    fix_path(-1);
+    thaw();
+    return true;
 }
 
-template <typename T>
-bool BST<T>::search(std::unique_ptr<TreeNode<T>>& t, const T& key) {
-
-    // TODO
-    // if key exists in tree, return true
-    // otherwise, return false
-    if(t == nullptr){
-        return false;
+template <typename T, typename Balance>
+void BST<T, Balance>::clear() {
+    // Destructors only matter for non-trivial T. They are run by
+    // rotating each left child up until the node in hand has none, which
+    // visits every node once in O(1) extra space.
+    if(!std::is_trivially_destructible<T>::value){
+        TreeNode<T>* t = root;
+        while(t != nullptr){
+            if(t->left != nullptr){
+                TreeNode<T>* l = t->left;
+                t->left = l->right;
+                l->right = t;
+                t = l;
+            }
+            else{
+                TreeNode<T>* r = t->right;
+                t->~TreeNode();
+                t = r;
+            }
+        }
     }
-    else if(t -> element == key){
-        return true;
+    root = nullptr;
+    pool.release();
+    thaw();
+}
+
+template <typename T, typename Balance>
+size_t BST<T, Balance>::get_size() {
+    return TreeNode<T>::size_of(root);
+}
+
+template <typename T, typename Balance>
+const T* BST<T, Balance>::select(size_t k) {
+    TreeNode<T>* t = root;
+    while(t != nullptr){
+        size_t left = TreeNode<T>::size_of(t->left);
+        if(k < left){
+            t = t->left;
+        }
+        else if(k == left){
+            return &t->element;
+        }
+        else{
+            k -= left + 1;
+            t = t->right;
+        }
     }
-    else{
-        if(t -> element > key){
-            return search(t -> left, key);
-            
+    return nullptr;
+}
+
+template <typename T, typename Balance>
+size_t BST<T, Balance>::rank(const T& key) {
+    size_t r = 0;
+    TreeNode<T>* t = root;
+    while(t != nullptr){
+        if(t->element < key){
+            r += TreeNode<T>::size_of(t->left) + 1;
+            t = t->right;
         }
         else{
-            return search(t -> right, key);
-            
+            t = t->left;
         }
     }
+    return r;
 }
 
-template <typename T>
-T BST<T>::find_rightmost_key(std::unique_ptr<TreeNode<T>>& t) {
-    // TODO
-    if(t -> right == nullptr){
-        return t->element;
+template <typename T, typename Balance>
+size_t BST<T, Balance>::count_range(const T& lo, const T& hi) {
+    if(hi < lo){
+        return 0;
     }
-    else{
-        return find_rightmost_key(t -> right);
+    // keys <= hi, minus keys < lo
+    size_t upto = 0;
+    TreeNode<T>* t = root;
+    while(t != nullptr){
+        if(hi < t->element){
+            t = t->left;
+        }
+        else{
+            upto += TreeNode<T>::size_of(t->left) + 1;
+            t = t->right;
+        }
     }
+    return upto - rank(lo);
 }
 
-template <typename T>
-bool BST<T>::remove(std::unique_ptr<TreeNode<T>>& t, const T& key) {
+template <typename T, typename Balance>
+BST<T, Balance>::RangeIterator::RangeIterator(TreeNode<T>* root, const T& lo, const T& hi)
+    : hi{hi} {
+    // keep the ancestors >= lo on the way down to the first key >= lo
+    while(root != nullptr){
+        if(root->element < lo){
+            root = root->right;
+        }
+        else{
+            stack.push_back(root);
+            root = root->left;
+        }
+    }
+    check_end();
+}
 
-    // TODO
-    // if key does not exist in tree, return false
-    // otherwise, return true
+template <typename T, typename Balance>
+void BST<T, Balance>::RangeIterator::push_left(TreeNode<T>* t) {
+    while(t != nullptr){
+        stack.push_back(t);
+        t = t->left;
+    }
+}
 
-    if(t == nullptr){
-        return false;
+template <typename T, typename Balance>
+void BST<T, Balance>::RangeIterator::check_end() {
+    if(!stack.empty() && *hi < stack.back()->element){
+        stack.clear();
     }
-    else{
-        if(key > t -> element){
-            return remove(t -> right, key);
-        }
-        else if(key < t->element){
-            return remove(t -> left, key);
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::RangeIterator& BST<T, Balance>::RangeIterator::operator++() {
+    TreeNode<T>* t = stack.back();
+    stack.pop_back();
+    push_left(t->right);
+    check_end();
+    return *this;
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Range BST<T, Balance>::range(const T& lo, const T& hi) {
+    return Range{RangeIterator(root, lo, hi)};
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::begin() {
+    return Iterator(root != nullptr ? TreeNode<T>::leftmost(root) : nullptr, this);
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::end() {
+    return Iterator(nullptr, this);
+}
+
+template <typename T, typename Balance>
+template <typename Before>
+TreeNode<T>* BST<T, Balance>::first_not_before(TreeNode<T>* finger, Before before) {
+    TreeNode<T>* t = root;
+    TreeNode<T>* best = nullptr;
+    if(finger != nullptr){
+        // climb until the subtree of t holds the answer: every key of a
+        // subtree lies between its nearest ancestors on either side, so
+        // stop at the first such ancestor that is on the far side of key
+        t = finger;
+        if(before(t->element)){
+            // the answer is to the right of the finger
+            while(t->parent != nullptr){
+                if(t->parent->left == t && !before(t->parent->element)){
+                    best = t->parent;
+                    break;
+                }
+                t = t->parent;
+            }
         }
         else{
-            // TODO when key == t -> element
-            if(t->right == nullptr && t->left == nullptr){
-                t.reset();
-            }
-            else if(t->right != nullptr && t->left == nullptr){
-                t = std::move(t->right);
+            // the answer is the finger or to its left
+            while(t->parent != nullptr){
+                if(t->parent->right == t && before(t->parent->element)){
+                    break;
+                }
+                t = t->parent;
             }
-            else if(t->left != nullptr && t->right == nullptr){
-                t = std::move(t->left);
+        }
+    }
+    while(t != nullptr){
+        if(before(t->element)){
+            t = t->right;
+        }
+        else{
+            best = t;
+            t = t->left;
+        }
+    }
+    return best;
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::lower_bound(const T& key, Iterator finger) {
+    return Iterator(first_not_before(finger.node, [&](const T& e){ return e < key; }), this);
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::upper_bound(const T& key, Iterator finger) {
+    return Iterator(first_not_before(finger.node, [&](const T& e){ return !(key < e); }), this);
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::find(const T& key, Iterator finger) {
+    Iterator it = lower_bound(key, finger);
+    if(it.node != nullptr && key < it.node->element){
+        return end();
+    }
+    return it;
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::lower_bound(const T& key) {
+    return lower_bound(key, end());
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::upper_bound(const T& key) {
+    return upper_bound(key, end());
+}
+
+template <typename T, typename Balance>
+typename BST<T, Balance>::Iterator BST<T, Balance>::find(const T& key) {
+    return find(key, end());
+}
+
+template <typename T, typename Balance>
+template <typename It>
+void BST<T, Balance>::build_from_sorted(It first, It last) {
+    clear();
+    size_t n = std::distance(first, last);
+    if(n == 0){
+        return;
+    }
+
+    TreeNode<T>* nodes = pool.allocate_contiguous(n);
+    for(size_t i = 0; i < n; i++, ++first){
+        new (&nodes[i]) TreeNode<T>(*first);
+    }
+
+    size_t height = 0;
+    while((size_t(1) << height) <= n){
+        height++;
+    }
+
+    // the middle of each index range becomes the root of its subtree;
+    // ranges are expanded from an explicit stack
+    struct Range { size_t lo, hi, depth; TreeNode<T>** link; TreeNode<T>* parent; };
+    std::vector<Range> ranges;
+    ranges.push_back(Range{0, n, 0, &root, nullptr});
+    while(!ranges.empty()){
+        Range r = ranges.back();
+        ranges.pop_back();
+        if(r.lo == r.hi){
+            *r.link = nullptr;
+            continue;
+        }
+        size_t mid = r.lo + (r.hi - r.lo) / 2;
+        TreeNode<T>* t = &nodes[mid];
+        t->size = r.hi - r.lo;
+        t->parent = r.parent;
+        Balance::init_bulk(t, r.depth, height);
+        *r.link = t;
+        ranges.push_back(Range{r.lo, mid, r.depth + 1, &t->left, t});
+        ranges.push_back(Range{mid + 1, r.hi, r.depth + 1, &t->right, t});
+    }
+}
+
+template <typename T, typename Balance>
+std::vector<T> BST<T, Balance>::to_sorted_vector() {
+    std::vector<T> keys;
+    keys.reserve(get_size());
+    std::vector<TreeNode<T>*> stack;
+    TreeNode<T>* t = root;
+    while(t != nullptr || !stack.empty()){
+        while(t != nullptr){
+            stack.push_back(t);
+            t = t->left;
+        }
+        t = stack.back();
+        stack.pop_back();
+        keys.push_back(t->element);
+        t = t->right;
+    }
+    return keys;
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::freeze() {
+    size_t n = get_size();
+    frozen.clear();
+    frozen_valid = true;
+    if(n == 0){
+        return;
+    }
+
+    // walk the tree in order and the implicit array in order side by
+    // side; index k has children 2k and 2k + 1
+    frozen.assign(n + 1, root->element);
+    size_t k = 1;
+    while(2 * k <= n){
+        k *= 2;
+    }
+    std::vector<TreeNode<T>*> stack;
+    TreeNode<T>* t = root;
+    while(t != nullptr || !stack.empty()){
+        while(t != nullptr){
+            stack.push_back(t);
+            t = t->left;
+        }
+        t = stack.back();
+        stack.pop_back();
+        frozen[k] = t->element;
+        t = t->right;
+
+        // in-order successor of k
+        if(2 * k + 1 <= n){
+            k = 2 * k + 1;
+            while(2 * k <= n){
+                k *= 2;
             }
-            else{
-                t->element = find_rightmost_key(t->left);
-                return remove(t-> left, t->element);
+        }
+        else{
+            while(k & 1){
+                k >>= 1;
             }
+            k >>= 1;
         }
-        return true;
     }
+}
+
+template <typename T, typename Balance>
+bool BST<T, Balance>::is_frozen() {
+    return frozen_valid;
+}
 
+template <typename T, typename Balance>
+bool BST<T, Balance>::search_frozen(const T& key) {
+    if(frozen.empty()){
+        return false;
+    }
+    size_t n = frozen.size() - 1;
+    const T* a = frozen.data();
+    size_t k = 1;
+    while(k <= n){
+        // 16 descendants four levels down; one cache line for small T
+        __builtin_prefetch(a + std::min(16 * k, n));
+        k = 2 * k + (a[k] < key);
+    }
+    // strip the right turns taken after the last left turn: k is then
+    // the first key >= key, or 0 if there is none
+    k >>= __builtin_ffsl(~k);
+    return k != 0 && a[k] == key;
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::thaw() {
+    if(frozen_valid){
+        frozen.clear();
+        frozen_valid = false;
+    }
 }
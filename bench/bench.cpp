@@ -0,0 +1,869 @@
+/*
+ * Microbenchmarks behind the figures quoted in the commit history.
+ *
+ * Build from this directory and run one benchmark at a time:
+ *
+ *   g++ -std=c++17 -O2 -iquote .. bench.cpp -o bench -lpthread
+ *   ./bench probe
+ *
+ * `./bench' with no arguments lists the benchmarks. Timings are wall
+ * clock unless a benchmark says otherwise, so run on an idle machine and
+ * expect some run-to-run noise.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <time.h>
+
+#include "Binary Search Tree.hpp"
+#include "concurrent_hash_table.hpp"
+#include "hash_funcs.hpp"
+#include "hash_snapshot.hpp"
+#include "hash_table.hpp"
+#include "rbtree.hpp"
+#include "sharded_hash_table.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static double ns_per_op(Clock::time_point start, Clock::time_point end, size_t ops) {
+    return std::chrono::duration<double, std::nano>(end - start).count() / ops;
+}
+
+/* Distinct random keys in random order */
+static std::vector<int> distinct_keys(size_t n, unsigned seed) {
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (int)i;
+    }
+    std::mt19937 rng(seed);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+/* Bytes the program holds from malloc, overheads included */
+static size_t heap_bytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/*
+ * put() and remove() walk the probe chain once. The old put() first ran
+ * a get(), which on a miss walks the same chain to the same empty slot,
+ * and the old remove() ran get() twice before walking the chain a third
+ * time. Keys here are inserted into a table without tombstones, so the
+ * old code walked exactly 2x (put) and 3x (remove) the chain that the
+ * single pass reports. The probe columns count slots visited per
+ * operation. The timed "old call pattern" columns issue the same
+ * get()/put()/remove() sequence through today's code, which stands in
+ * for the old code paths but is not them.
+ */
+static void bench_probe() {
+    const size_t n = 1000000;
+    std::vector<int> keys = distinct_keys(n, 1);
+    LinearProbeHashTable<int, int, FastHash> single, chained;
+    long put_probes = 0, remove_probes = 0;
+    int v;
+
+    Clock::time_point t0 = Clock::now();
+    for (int k : keys) {
+        put_probes += single.put(k, k);
+    }
+    Clock::time_point t1 = Clock::now();
+    for (int k : keys) {
+        if (chained.get(k, v) == -1) {
+            chained.put(k, k);
+        }
+    }
+    Clock::time_point t2 = Clock::now();
+    for (int k : keys) {
+        remove_probes += single.remove(k);
+    }
+    Clock::time_point t3 = Clock::now();
+    for (int k : keys) {
+        if (chained.get(k, v) != -1 && chained.get(k, v) != -1) {
+            chained.remove(k);
+        }
+    }
+    Clock::time_point t4 = Clock::now();
+
+    printf("n=%zu           probes/op            ns/op\n", n);
+    printf("         single pass  old code   single pass  old call pattern\n");
+    printf("  %-6s %11.2f %9.2f %13.1f %17.1f\n", "put",
+           (double)put_probes / n, 2.0 * put_probes / n,
+           ns_per_op(t0, t1, n), ns_per_op(t1, t2, n));
+    printf("  %-6s %11.2f %9.2f %13.1f %17.1f\n", "remove",
+           (double)remove_probes / n, 3.0 * remove_probes / n,
+           ns_per_op(t2, t3, n), ns_per_op(t3, t4, n));
+}
+
+/*
+ * Delete-heavy churn: a fixed set of live keys where each step removes a
+ * random live key and inserts a fresh one. Tombstones are dropped on
+ * rebuild, so probe counts should stay flat however long it runs.
+ */
+template <typename Table>
+static void churn(const char *name) {
+    const size_t live_keys = 1000;
+    const size_t ops = 2000000;
+    Table t;
+    std::mt19937 rng(2);
+    std::vector<int> live;
+    int next = 0;
+    long put_probes = 0;
+    int max_put_probes = 0;
+
+    for (size_t i = 0; i < live_keys; i++) {
+        t.put(next, 0);
+        live.push_back(next++);
+    }
+    for (size_t i = 0; i < ops; i++) {
+        size_t j = rng() % live.size();
+        t.remove(live[j]);
+        live[j] = next++ * 7;
+        int probe = t.put(live[j], 0);
+        put_probes += probe;
+        max_put_probes = std::max(max_put_probes, probe);
+    }
+
+    long get_probes = 0;
+    int v;
+    for (int k : live) {
+        get_probes += t.get(k, v);
+    }
+    printf("%-6s avg put probes %.2f (max %d), avg get probes %.2f, "
+           "table %zu, tombstones %zu\n", name,
+           (double)put_probes / ops, max_put_probes,
+           (double)get_probes / live.size(),
+           t.get_table_size(), t.get_tombstone_count());
+}
+
+static void bench_churn() {
+    churn<LinearProbeHashTable<int, int> >("linear");
+    churn<QuadProbeHashTable<int, int> >("quad");
+}
+
+/*
+ * Per-put latency while growing a table from empty to n keys. With
+ * ALL_AT_ONCE the worst put pays for a whole rehash and grows with n;
+ * INCREMENTAL spreads the rehash and the freeing of the old table out,
+ * so its worst put should not depend on n. Latency is the thread's CPU
+ * time, so that being preempted on a busy machine does not show up as
+ * a slow put.
+ */
+static double thread_cpu_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+template <typename Table>
+static void resize_latency(ResizeMode mode, const char *name) {
+    const size_t sizes[] = {1000000, 4000000, 16000000};
+
+    for (size_t n : sizes) {
+        Table t(FastHash(), mode);
+        std::vector<double> ns(n);
+
+        for (size_t i = 0; i < n; i++) {
+            double start = thread_cpu_ns();
+            t.put((int)i, (int)i);
+            ns[i] = thread_cpu_ns() - start;
+        }
+        std::sort(ns.begin(), ns.end());
+        printf("%-20s n=%-9zu p50 %5.0f ns  p99.99 %7.0f ns  max %8.3f ms\n",
+               name, n, ns[n / 2], ns[n - n / 10000], ns[n - 1] / 1e6);
+    }
+}
+
+static void bench_resize() {
+    resize_latency<LinearProbeHashTable<int, int, FastHash> >(
+        ResizeMode::ALL_AT_ONCE, "all-at-once");
+    resize_latency<LinearProbeHashTable<int, int, FastHash> >(
+        ResizeMode::INCREMENTAL, "incremental");
+    resize_latency<LinearProbeHashTable<int, int, FastHash, SplitSlotArray<int, int> > >(
+        ResizeMode::INCREMENTAL, "incremental, split");
+}
+
+/*
+ * Put+get throughput of 4 threads over ShardedHashTable. In LOCKED mode
+ * every thread inserts random keys; in SHARED_NOTHING mode each thread
+ * owns every 4th shard and only inserts keys routed to its shards.
+ */
+static void sharded_run(size_t num_shards, ShardMode mode) {
+    typedef ShardedHashTable<uint64_t, uint64_t, FastHash> Table;
+    const int num_threads = 4;
+    const size_t ops = 1 << 20;
+    Table t(FastHash(), num_shards, mode);
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int w = 0; w < num_threads; w++) {
+        workers.emplace_back([&t, mode, cpus, w]() {
+            std::mt19937_64 rng(w);
+            uint64_t v;
+            if (mode == ShardMode::SHARED_NOTHING) {
+                for (size_t s = w; s < t.get_num_shards(); s += num_threads) {
+                    t.attach_owner(s, w % cpus);
+                }
+            }
+            for (size_t done = 0; done < ops; ) {
+                uint64_t k = rng();
+                if (mode == ShardMode::SHARED_NOTHING &&
+                    t.shard_of(k) % num_threads != (size_t)w) {
+                    continue;
+                }
+                t.put(k, k);
+                t.get(k, v);
+                done++;
+            }
+        });
+    }
+    for (std::thread &th : workers) {
+        th.join();
+    }
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    printf("shards %3zu %-14s %5.2f Mops/s\n", num_shards,
+           mode == ShardMode::LOCKED ? "locked" : "shared-nothing",
+           num_threads * ops * 2 / us);
+}
+
+static void bench_sharded() {
+    const size_t shard_counts[] = {1, 4, 16, 64};
+    for (size_t n : shard_counts) {
+        sharded_run(n, ShardMode::LOCKED);
+    }
+    /* shared-nothing needs at least one shard per thread */
+    for (size_t n : shard_counts) {
+        if (n >= 4) {
+            sharded_run(n, ShardMode::SHARED_NOTHING);
+        }
+    }
+}
+
+/*
+ * Uniform random searches on a BST built by random inserts, first on
+ * the pointer tree and then on its frozen Eytzinger copy. Half of the
+ * searched keys are absent.
+ */
+static void bench_freeze() {
+    const size_t sizes[] = {1000, 100000, 1000000, 10000000};
+    const size_t queries = 2000000;
+
+    for (size_t n : sizes) {
+        std::mt19937 rng(n);
+        std::vector<int> keys = distinct_keys(n, n);
+        std::vector<int> q(queries);
+        for (int &x : q) {
+            x = rng() % (2 * n);
+        }
+
+        BST<int, WeightBalance> tree;
+        for (int k : keys) {
+            tree.insert(k * 2);
+        }
+        size_t hits = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int x : q) {
+            hits += tree.search(x);
+        }
+        Clock::time_point t1 = Clock::now();
+        tree.freeze();
+        Clock::time_point t2 = Clock::now();
+        for (int x : q) {
+            hits += tree.search(x);
+        }
+        Clock::time_point t3 = Clock::now();
+
+        printf("n=%-9zu pointer %6.1f ns  frozen %6.1f ns  (%zu hits)\n", n,
+               ns_per_op(t0, t1, queries), ns_per_op(t2, t3, queries), hits);
+    }
+}
+
+/*
+ * RBTree insert, duplicate insert, contains() and remove of distinct
+ * uint64_t keys in random order, and the heap bytes the tree holds per
+ * node.
+ * Half of the contains() queries miss. Only insert(), contains() and
+ * remove() are used, so the benchmark also builds against older
+ * versions of rbtree.hpp placed first on the include path
+ * (-iquote <dir> before -iquote ..).
+ */
+static void bench_rbtree() {
+    const size_t sizes[] = {1000000, 10000000};
+
+    for (size_t n : sizes) {
+        std::vector<int> shuffled = distinct_keys(n, 3);
+        std::vector<uint64_t> keys(shuffled.begin(), shuffled.end());
+        std::vector<uint64_t> queries(n);
+        for (size_t i = 0; i < n; i++) {
+            queries[i] = i % 2 ? keys[i] : keys[i] + n;
+        }
+        size_t hits = 0;
+        size_t before = heap_bytes();
+        RBTree<uint64_t> t;
+
+        Clock::time_point t0 = Clock::now();
+        for (uint64_t k : keys) {
+            t.insert(k);
+        }
+        Clock::time_point t1 = Clock::now();
+        double bytes = (double)(heap_bytes() - before) / n;
+        for (uint64_t k : keys) {
+            t.insert(k);
+        }
+        Clock::time_point t2 = Clock::now();
+        for (uint64_t k : queries) {
+            hits += t.contains(k);
+        }
+        Clock::time_point t3 = Clock::now();
+        for (uint64_t k : keys) {
+            t.remove(k);
+        }
+        Clock::time_point t4 = Clock::now();
+
+        printf("n=%-9zu insert %5.0f ns  dup insert %5.0f ns  contains %5.0f ns  "
+               "remove %5.0f ns  %5.1f bytes/node  (%zu hits)\n", n,
+               ns_per_op(t0, t1, n), ns_per_op(t1, t2, n), ns_per_op(t2, t3, n),
+               ns_per_op(t3, t4, n), bytes, hits);
+    }
+}
+
+/*
+ * Throughput of ConcurrentHashTable against a LinearProbeHashTable behind
+ * one global mutex, the setup it replaces. Each thread runs a random mix
+ * of get and put/remove (half each) over 1M keys, half of which are
+ * present at the start. The total number of operations is fixed, so
+ * Mops/s is comparable across thread counts.
+ */
+template <typename Table>
+static double concurrent_run(Table &t, std::mutex *lock, int num_threads, int read_pct) {
+    const size_t key_space = 1 << 20;
+    const size_t total_ops = 1 << 21;
+
+    for (uint64_t k = 0; k < key_space; k += 2) {
+        t.put(k, k);
+    }
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> workers;
+    for (int w = 0; w < num_threads; w++) {
+        workers.emplace_back([&t, lock, num_threads, read_pct, w]() {
+            std::mt19937_64 rng(w);
+            uint64_t v;
+            for (size_t i = 0; i < total_ops / num_threads; i++) {
+                uint64_t r = rng();
+                uint64_t k = r % key_space;
+                int op = (r >> 32) % 100;
+                std::unique_lock<std::mutex> guard;
+                if (lock) {
+                    guard = std::unique_lock<std::mutex>(*lock);
+                }
+                if (op < read_pct) {
+                    t.get(k, v);
+                }
+                else if (op % 2 == 0) {
+                    t.put(k, k);
+                }
+                else {
+                    t.remove(k);
+                }
+            }
+        });
+    }
+    for (std::thread &th : workers) {
+        th.join();
+    }
+    double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    return total_ops / num_threads * num_threads / us;
+}
+
+static void bench_concurrent() {
+    const int thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+    const int read_pcts[] = {50, 90, 99};
+
+    printf("%-8s %-8s %14s %14s  (Mops/s)\n", "reads", "threads", "concurrent", "global mutex");
+    for (int read_pct : read_pcts) {
+        for (int num_threads : thread_counts) {
+            ConcurrentHashTable<uint64_t, uint64_t, FastHash> concurrent;
+            LinearProbeHashTable<uint64_t, uint64_t, FastHash> locked;
+            std::mutex lock;
+            double c = concurrent_run(concurrent, nullptr, num_threads, read_pct);
+            double l = concurrent_run(locked, &lock, num_threads, read_pct);
+            printf("%3d%%     %-8d %14.2f %14.2f\n", read_pct, num_threads, c, l);
+        }
+    }
+}
+
+/*
+ * SlotArray against SplitSlotArray for int and std::string keys: heap
+ * bytes per entry (as counted by malloc, so string contents and empty
+ * slots are included) and random get() time for keys that are present
+ * and keys that are not.
+ */
+template <typename K, typename Layout>
+static void layout_run(const char *name, const std::vector<K> &present,
+                       const std::vector<K> &absent) {
+    const size_t queries = 2000000;
+    size_t n = present.size();
+    std::mt19937 rng(5);
+    std::vector<const K *> hits(queries), misses(queries);
+    for (size_t i = 0; i < queries; i++) {
+        hits[i] = &present[rng() % n];
+        misses[i] = &absent[rng() % absent.size()];
+    }
+
+    size_t before = heap_bytes();
+    {
+        LinearProbeHashTable<K, int, FastHash, Layout> t;
+        for (size_t i = 0; i < n; i++) {
+            t.put(present[i], (int)i);
+        }
+        double bytes = (double)(heap_bytes() - before) / n;
+
+        int v, found = 0;
+        Clock::time_point t0 = Clock::now();
+        for (const K *k : hits) {
+            found += t.get(*k, v) != -1;
+        }
+        Clock::time_point t1 = Clock::now();
+        for (const K *k : misses) {
+            found += t.get(*k, v) != -1;
+        }
+        Clock::time_point t2 = Clock::now();
+
+        printf("%-22s n=%-8zu %6.1f bytes/entry  hit %6.1f ns  miss %6.1f ns  (%d)\n",
+               name, n, bytes, ns_per_op(t0, t1, queries), ns_per_op(t1, t2, queries), found);
+    }
+}
+
+static std::string string_key(size_t i) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "user:%012zu", i);
+    return buf;
+}
+
+static void bench_layout() {
+    const size_t sizes[] = {1000000, 8000000};
+
+    for (size_t n : sizes) {
+        std::vector<int> present(n), absent(n);
+        for (size_t i = 0; i < n; i++) {
+            present[i] = (int)(2 * i);
+            absent[i] = (int)(2 * i + 1);
+        }
+        layout_run<int, SlotArray<int, int> >("int, SlotArray", present, absent);
+        layout_run<int, SplitSlotArray<int, int> >("int, SplitSlotArray", present, absent);
+    }
+
+    /* 17-character keys, too long for the short-string buffer */
+    const size_t n = 1000000;
+    std::vector<std::string> present(n), absent(n);
+    for (size_t i = 0; i < n; i++) {
+        present[i] = string_key(2 * i);
+        absent[i] = string_key(2 * i + 1);
+    }
+    layout_run<std::string, SlotArray<std::string, int> >(
+        "string, SlotArray", present, absent);
+    layout_run<std::string, SplitSlotArray<std::string, int> >(
+        "string, SplitSlotArray", present, absent);
+}
+
+/*
+ * get_batch() against a loop of scalar get() calls on tables far larger
+ * than the last-level cache, for a few batch sizes. Half of the looked-up
+ * keys are absent. put_batch() against put() is timed while building the
+ * table from empty.
+ */
+template <typename Layout>
+static void batch_run(const char *name, size_t n) {
+    const size_t queries = 4000000;
+    const size_t batch_sizes[] = {32, 128, 256};
+    std::vector<int> keys = distinct_keys(n, 7);
+    std::vector<int> probes(std::max(n, queries)), out(queries);
+    LinearProbeHashTable<int, int, FastHash, Layout> scalar, batched;
+
+    Clock::time_point t0 = Clock::now();
+    for (size_t i = 0; i < n; i++) {
+        scalar.put(keys[i], keys[i]);
+    }
+    Clock::time_point t1 = Clock::now();
+    batched.put_batch(keys.data(), keys.data(), n, probes.data());
+    Clock::time_point t2 = Clock::now();
+    printf("%-16s n=%-9zu put %6.1f ns  put_batch %6.1f ns\n", name, n,
+           ns_per_op(t0, t1, n), ns_per_op(t1, t2, n));
+
+    std::mt19937 rng(8);
+    std::vector<int> q(queries);
+    for (int &x : q) {
+        x = rng() % (2 * n);
+    }
+    int v;
+    size_t hits = 0;
+    t0 = Clock::now();
+    for (int k : q) {
+        hits += scalar.get(k, v) != -1;
+    }
+    t1 = Clock::now();
+    printf("%-16s %-11s get %6.1f ns", "", "", ns_per_op(t0, t1, queries));
+    for (size_t b : batch_sizes) {
+        t0 = Clock::now();
+        for (size_t i = 0; i < queries; i += b) {
+            batched.get_batch(&q[i], std::min(b, queries - i), &out[i], &probes[i]);
+        }
+        t1 = Clock::now();
+        printf("  batch %zu %6.1f ns", b, ns_per_op(t0, t1, queries));
+    }
+    printf("  (%zu hits)\n", hits);
+}
+
+static void bench_batch() {
+    const size_t sizes[] = {8000000, 16000000};
+    for (size_t n : sizes) {
+        batch_run<SlotArray<int, int> >("SlotArray", n);
+        batch_run<SplitSlotArray<int, int> >("SplitSlotArray", n);
+    }
+}
+
+/*
+ * Heap allocations and value copies per operation for std::string keys
+ * and a string-carrying value that counts its copies and moves. Every
+ * operator new in the process is counted, per thread; keys and values
+ * are built before counting starts, so what is left is the table's own
+ * work, rehashes included.
+ */
+static thread_local size_t allocations;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+struct Counted {
+    static size_t copies;
+    static size_t moves;
+    std::string payload;
+
+    Counted(size_t n, char c): payload(n, c) {
+    }
+
+    Counted(const Counted &other): payload(other.payload) {
+        copies++;
+    }
+
+    Counted(Counted &&other) noexcept: payload(std::move(other.payload)) {
+        moves++;
+    }
+
+    Counted &operator=(const Counted &other) {
+        payload = other.payload;
+        copies++;
+        return *this;
+    }
+
+    Counted &operator=(Counted &&other) noexcept {
+        payload = std::move(other.payload);
+        moves++;
+        return *this;
+    }
+};
+
+size_t Counted::copies;
+size_t Counted::moves;
+
+typedef LinearProbeHashTable<std::string, Counted, FastHash> CountedTable;
+
+template <typename Op>
+static void alloc_run(const char *name, CountedTable &t, size_t n, Op op) {
+    allocations = Counted::copies = Counted::moves = 0;
+    for (size_t i = 0; i < n; i++) {
+        op(t, i);
+    }
+    printf("  %-32s %5.2f allocs  %5.2f copies  %5.2f moves  per op\n", name,
+           (double)allocations / n, (double)Counted::copies / n, (double)Counted::moves / n);
+}
+
+static void bench_alloc() {
+    const size_t n = 100000;
+    std::vector<std::string> keys(n);
+    std::vector<Counted> values;
+    values.reserve(n);
+
+    printf("n=%zu, 16-character keys, 64-character values\n", n);
+    {
+        CountedTable t;
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = string_key(i);
+            values.emplace_back(64, 'v');
+        }
+        alloc_run("put(const K &, const V &)", t, n, [&](CountedTable &t, size_t i) {
+            t.put(keys[i], values[i]);
+        });
+        alloc_run("find(key)", t, n, [&](CountedTable &t, size_t i) {
+            t.find(keys[i]);
+        });
+        Counted out(64, 'o');
+        alloc_run("get(key, value)", t, n, [&](CountedTable &t, size_t i) {
+            t.get(keys[i], out);
+        });
+        alloc_run("try_emplace, key present", t, n, [&](CountedTable &t, size_t i) {
+            t.try_emplace(keys[i], 64, 'v');
+        });
+    }
+    {
+        CountedTable t;
+        alloc_run("put(K &&, V &&)", t, n, [&](CountedTable &t, size_t i) {
+            t.put(std::move(keys[i]), std::move(values[i]));
+        });
+    }
+    {
+        CountedTable t;
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = string_key(i);
+        }
+        alloc_run("try_emplace(K &&, 64, 'v')", t, n, [&](CountedTable &t, size_t i) {
+            t.try_emplace(std::move(keys[i]), 64, 'v');
+        });
+    }
+    {
+        CountedTable t;
+        values.clear();
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = string_key(i);
+            values.emplace_back(64, 'v');
+        }
+        alloc_run("emplace(K &&, V &&)", t, n, [&](CountedTable &t, size_t i) {
+            t.emplace(std::move(keys[i]), std::move(values[i]));
+        });
+    }
+}
+
+/*
+ * Restart cost: rebuilding a table by replaying n puts against opening a
+ * snapshot of it and serving the first get. The snapshot was just
+ * written, so its pages are in the page cache; a cold cache adds the
+ * disk read to the checksummed open and spreads it over the first gets
+ * of the unchecked one. The last column is the average get() over all
+ * n keys once the table or mapping is up.
+ */
+static void restart_run(size_t n) {
+    const char *path = "bench_restart.snap";
+    std::vector<uint64_t> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (uint64_t)i * 0x9e3779b97f4a7c15ull;
+    }
+    uint64_t v;
+
+    {
+        Clock::time_point t0 = Clock::now();
+        LinearProbeHashTable<uint64_t, uint64_t, FastHash> t;
+        for (size_t i = 0; i < n; i++) {
+            t.put(keys[i], i);
+        }
+        t.get(keys[0], v);
+        Clock::time_point t1 = Clock::now();
+        for (uint64_t k : keys) {
+            t.get(k, v);
+        }
+        Clock::time_point t2 = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        printf("  n=%-9zu %-26s %10.2f ms %8.1f ns\n", n, "replay puts",
+               ms, ns_per_op(t1, t2, n));
+        if (!save_snapshot(t, path)) {
+            printf("  cannot write %s\n", path);
+            return;
+        }
+    }
+    for (int verify = 1; verify >= 0; verify--) {
+        Clock::time_point t0 = Clock::now();
+        HashTableSnapshot<uint64_t, uint64_t, LinearProbe, FastHash> s;
+        if (!s.open(path, verify)) {
+            printf("  cannot open %s\n", path);
+            break;
+        }
+        s.get(keys[0], v);
+        Clock::time_point t1 = Clock::now();
+        for (uint64_t k : keys) {
+            s.get(k, v);
+        }
+        Clock::time_point t2 = Clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        printf("  n=%-9zu %-26s %10.2f ms %8.1f ns\n", n,
+               verify ? "open snapshot, checksum" : "open snapshot, no checksum",
+               ms, ns_per_op(t1, t2, n));
+    }
+    std::remove(path);
+}
+
+static void bench_restart() {
+    printf("  %-38s %13s %11s\n", "uint64_t keys and values", "to first get", "get/op");
+    for (size_t n : {1000000, 8000000}) {
+        restart_run(n);
+    }
+}
+
+/*
+ * Unbalanced BST build, search and teardown for random and sorted key
+ * orders. Sorted keys make the tree a list, so that run is kept small:
+ * each insert walks every node already there. Teardown is the time to
+ * delete the whole tree.
+ */
+static void bst_run(const char *order, const std::vector<int> &keys) {
+    size_t n = keys.size();
+    size_t hits = 0;
+    BST<int> *tree = new BST<int>;
+
+    Clock::time_point t0 = Clock::now();
+    for (int k : keys) {
+        tree->insert(k);
+    }
+    Clock::time_point t1 = Clock::now();
+    for (int k : keys) {
+        hits += tree->search(k);
+    }
+    Clock::time_point t2 = Clock::now();
+    delete tree;
+    Clock::time_point t3 = Clock::now();
+
+    printf("%-7s n=%-7zu insert %8.1f ns  search %8.1f ns  teardown %7.2f ms  (%zu hits)\n",
+           order, n, ns_per_op(t0, t1, n), ns_per_op(t1, t2, n),
+           std::chrono::duration<double, std::milli>(t3 - t2).count(), hits);
+}
+
+static void bench_bst() {
+    bst_run("random", distinct_keys(200000, 4));
+    std::vector<int> sorted(10000);
+    for (size_t i = 0; i < sorted.size(); i++) {
+        sorted[i] = (int)i;
+    }
+    bst_run("sorted", sorted);
+}
+
+/* Levels on the longest root-to-leaf path */
+static size_t bst_height(const TreeNode<int> *root) {
+    std::vector<std::pair<const TreeNode<int> *, size_t>> stack;
+    size_t height = 0;
+    if (root) {
+        stack.push_back({root, 1});
+    }
+    while (!stack.empty()) {
+        const TreeNode<int> *t = stack.back().first;
+        size_t depth = stack.back().second;
+        stack.pop_back();
+        height = std::max(height, depth);
+        if (t->left) {
+            stack.push_back({t->left, depth + 1});
+        }
+        if (t->right) {
+            stack.push_back({t->right, depth + 1});
+        }
+    }
+    return height;
+}
+
+/*
+ * Search latency per balancing policy after inserting 20k keys in
+ * sorted, reverse-sorted and random order. Every key is then searched
+ * once, in random order. The unbalanced tree degenerates into a list on
+ * sorted input, which is what keeps n this small.
+ */
+template <typename Balance>
+static void balance_run(const char *name) {
+    const size_t n = 20000;
+    std::vector<int> queries = distinct_keys(n, 6);
+    std::vector<int> sorted(n);
+    for (size_t i = 0; i < n; i++) {
+        sorted[i] = (int)i;
+    }
+    std::vector<int> reverse(sorted.rbegin(), sorted.rend());
+    const std::pair<const char *, const std::vector<int> *> orders[] = {
+        {"sorted", &sorted}, {"reverse", &reverse}, {"random", &queries},
+    };
+
+    printf("%-12s", name);
+    for (const auto &order : orders) {
+        BST<int, Balance> tree;
+        for (int k : *order.second) {
+            tree.insert(k);
+        }
+        size_t hits = 0;
+        Clock::time_point t0 = Clock::now();
+        for (int k : queries) {
+            hits += tree.search(k);
+        }
+        Clock::time_point t1 = Clock::now();
+        if (hits != n) {
+            printf("  %s: %zu of %zu keys found\n", order.first, hits, n);
+            return;
+        }
+        printf("  %-7s %8.1f ns %6zu deep", order.first, ns_per_op(t0, t1, n),
+               bst_height(tree.root));
+    }
+    printf("\n");
+}
+
+static void bench_balance() {
+    balance_run<NoBalance>("unbalanced");
+    balance_run<Treap>("treap");
+    balance_run<WeightBalance>("weight");
+}
+
+struct Bench {
+    const char *name;
+    void (*run)();
+    const char *what;
+};
+
+static const Bench benches[] = {
+    {"probe", bench_probe, "single-pass put/remove against get-then-probe"},
+    {"churn", bench_churn, "probe counts under remove/put churn"},
+    {"resize", bench_resize, "put latency while growing, per resize mode"},
+    {"sharded", bench_sharded, "4-thread put+get throughput per shard count"},
+    {"freeze", bench_freeze, "BST search, pointer tree against frozen copy"},
+    {"rbtree", bench_rbtree, "RBTree insert/remove/contains and bytes per node"},
+    {"concurrent", bench_concurrent, "threads x read ratio, concurrent against global mutex"},
+    {"layout", bench_layout, "SlotArray against SplitSlotArray, memory and get()"},
+    {"batch", bench_batch, "get_batch/put_batch against scalar get/put beyond LLC"},
+    {"alloc", bench_alloc, "allocations and value copies per put/emplace/find"},
+    {"restart", bench_restart, "restart by replaying puts against opening a snapshot"},
+    {"bst", bench_bst, "unbalanced BST insert/search/teardown, random and sorted keys"},
+    {"balance", bench_balance, "BST search and depth per balancing policy and key order"},
+};
+
+int main(int argc, char **argv) {
+    for (const Bench &b : benches) {
+        if (argc > 1 && strcmp(argv[1], b.name) == 0) {
+            b.run();
+            return 0;
+        }
+    }
+    fprintf(stderr, "usage: %s <benchmark>\n", argv[0]);
+    for (const Bench &b : benches) {
+        fprintf(stderr, "  %-10s %s\n", b.name, b.what);
+    }
+    return 1;
+}
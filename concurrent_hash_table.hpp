@@ -0,0 +1,383 @@
+#ifndef __CONCURRENT_HASH_TABLE_H_
+#define __CONCURRENT_HASH_TABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "hash_funcs.hpp"
+
+#define CONCURRENT_INITIAL_SEGMENT_SIZE 64
+#define CONCURRENT_DEFAULT_SEGMENTS 64
+
+/* Same thresholds as HashTable, applied per segment */
+#define CONCURRENT_MAX_LOAD_FACTOR 0.5
+#define CONCURRENT_MAX_USED_FACTOR 0.75
+
+/*
+ * Hash table for many concurrent readers and writers, with the same
+ * get/put/remove semantics and probe-count return values as HashTable.
+ *
+ * Keys are split over a power-of-two number of segments by the high bits
+ * of their (remixed) hash. Each segment is an independent linear probing
+ * table guarded by a mutex for writers and a sequence counter for
+ * readers:
+ *
+ *  - get() takes no lock and writes nothing shared. It reads the segment's
+ *    sequence number, probes, and retries if a writer bumped the sequence
+ *    in the meantime (seqlock). All slot fields are atomics, which is why
+ *    K and V must be trivially copyable.
+ *
+ *  - put()/remove() lock only their segment, so writers to different
+ *    segments never contend. A segment that fills up is resized by the
+ *    writer that noticed, off to the side, and swapped in with a single
+ *    pointer store. Readers of that segment keep probing the old table
+ *    until then, and writers elsewhere are not held up at all.
+ *
+ * Replaced tables cannot be freed while readers may still be probing
+ * them, so they are kept until the table is destroyed. Only growth
+ * replaces a table (tombstone cleanup rebuilds in place), and sizes
+ * double, so this at most doubles the memory held.
+ *
+ * The element count is a per-segment counter, summed on demand, instead
+ * of one global counter every writer bounces. It shares the segment's
+ * cache line with the lock and sequence counter, which the same writers
+ * touch anyway.
+ */
+template <typename K, typename V, typename Hash = VirtualHash>
+class ConcurrentHashTable {
+    static_assert(std::is_trivially_copyable<K>::value &&
+                  std::is_trivially_copyable<V>::value,
+                  "ConcurrentHashTable needs trivially copyable keys and values");
+
+public:
+    ConcurrentHashTable(Hash hash_func = Hash(),
+                        size_t num_segments = CONCURRENT_DEFAULT_SEGMENTS);
+    ~ConcurrentHashTable();
+    int get(const K &key, V &value);
+    int put(const K &key, const V &value);
+    int remove(const K &key);
+    size_t get_table_size();
+    size_t get_size();
+    double get_load_factor();
+
+private:
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t FULL = 1;
+    static constexpr uint8_t REMOVED = 2;
+
+    struct Slot {
+        std::atomic<uint8_t> state;
+        std::atomic<K> key;
+        std::atomic<V> value;
+    };
+
+    struct Table {
+        size_t table_size;
+        Slot *slots;
+
+        Table(size_t n): table_size(n), slots(new Slot[n]) {
+            for (size_t i = 0; i < n; i++) {
+                slots[i].state.store(EMPTY, std::memory_order_relaxed);
+            }
+        }
+
+        ~Table() {
+            delete[] slots;
+        }
+    };
+
+    struct alignas(64) Segment {
+        std::mutex lock;
+        std::atomic<uint64_t> seq;
+        std::atomic<Table *> table;
+        std::atomic<size_t> size;
+        size_t tombstones;
+        std::vector<Table *> retired;
+    };
+
+    Hash hash_func;
+    size_t num_segments;
+    unsigned segment_shift;
+    Segment *segments;
+
+    Segment &get_segment(unsigned long hash);
+    static bool find_slot(Table *t, const K &key, unsigned long hash,
+                          unsigned long &pos, int &probe);
+    static void write_begin(Segment &seg);
+    static void write_end(Segment &seg);
+    void rebuild(Segment &seg, size_t new_table_size);
+
+    // disallow copy and assignment
+    ConcurrentHashTable(const ConcurrentHashTable &);
+    ConcurrentHashTable & operator=(const ConcurrentHashTable &);
+};
+
+template <typename K, typename V, typename Hash>
+ConcurrentHashTable<K, V, Hash>::ConcurrentHashTable(Hash hash_func, size_t num_segments)
+    : hash_func(hash_func), num_segments(1), segment_shift(64) {
+    while (this->num_segments < num_segments) {
+        this->num_segments *= 2;
+        segment_shift--;
+    }
+    segments = new Segment[this->num_segments];
+    for (size_t i = 0; i < this->num_segments; i++) {
+        segments[i].seq.store(0, std::memory_order_relaxed);
+        segments[i].table.store(new Table(CONCURRENT_INITIAL_SEGMENT_SIZE),
+                                std::memory_order_relaxed);
+        segments[i].size.store(0, std::memory_order_relaxed);
+        segments[i].tombstones = 0;
+    }
+}
+
+template <typename K, typename V, typename Hash>
+ConcurrentHashTable<K, V, Hash>::~ConcurrentHashTable() {
+    for (size_t i = 0; i < num_segments; i++) {
+        delete segments[i].table.load(std::memory_order_relaxed);
+        for (Table *t : segments[i].retired) {
+            delete t;
+        }
+    }
+    delete[] segments;
+}
+
+/* The low hash bits pick the slot, so the segment comes from the high
+ * bits of a remixed hash; this also spreads weak hashes that leave the
+ * high bits zero. */
+template <typename K, typename V, typename Hash>
+typename ConcurrentHashTable<K, V, Hash>::Segment &
+ConcurrentHashTable<K, V, Hash>::get_segment(unsigned long hash) {
+    if (num_segments == 1) {
+        return segments[0];
+    }
+    return segments[((uint64_t)hash * 0x9E3779B97F4A7C15ULL) >> segment_shift];
+}
+
+/*
+ * Same single-pass walk as HashTable::find_slot. Every load is relaxed:
+ * writers run it under the segment lock, and readers validate whatever
+ * they saw against the sequence counter afterwards.
+ */
+template <typename K, typename V, typename Hash>
+bool ConcurrentHashTable<K, V, Hash>::find_slot(Table *t, const K &key, unsigned long hash,
+                                                unsigned long &pos, int &probe) {
+    size_t mask = t->table_size - 1;
+    unsigned long cur = hash & mask;
+    int free_probe = -1;
+
+    for (unsigned long step = 1; step <= t->table_size; step++) {
+        uint8_t state = t->slots[cur].state.load(std::memory_order_relaxed);
+        if (state == EMPTY) {
+            if (free_probe == -1) {
+                pos = cur;
+                free_probe = step;
+            }
+            break;
+        }
+        if (state == REMOVED) {
+            if (free_probe == -1) {
+                pos = cur;
+                free_probe = step;
+            }
+        }
+        else if (t->slots[cur].key.load(std::memory_order_relaxed) == key) {
+            pos = cur;
+            probe = step;
+            return true;
+        }
+        cur = (cur + 1) & mask;
+    }
+
+    probe = free_probe;
+    return false;
+}
+
+/* Writer side of the seqlock; the segment lock must be held */
+template <typename K, typename V, typename Hash>
+void ConcurrentHashTable<K, V, Hash>::write_begin(Segment &seg) {
+    seg.seq.store(seg.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename K, typename V, typename Hash>
+void ConcurrentHashTable<K, V, Hash>::write_end(Segment &seg) {
+    seg.seq.store(seg.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/*
+ * Rebuild the segment's table with `new_table_size' slots, dropping
+ * tombstones. The copy is built while readers keep using the current
+ * table. A larger table is published by a release store of the pointer,
+ * which get() pairs with an acquire load, and the old one is retired. A
+ * same-size rebuild is copied back over the current table instead, so
+ * that tombstone cleanup does not retire tables forever.
+ */
+template <typename K, typename V, typename Hash>
+void ConcurrentHashTable<K, V, Hash>::rebuild(Segment &seg, size_t new_table_size) {
+    Table *old_table = seg.table.load(std::memory_order_relaxed);
+    Table *new_table = new Table(new_table_size);
+    size_t mask = new_table_size - 1;
+
+    for (size_t i = 0; i < old_table->table_size; i++) {
+        Slot &s = old_table->slots[i];
+        if (s.state.load(std::memory_order_relaxed) != FULL) {
+            continue;
+        }
+        K key = s.key.load(std::memory_order_relaxed);
+        unsigned long pos = hash_func(key) & mask;
+        while (new_table->slots[pos].state.load(std::memory_order_relaxed) != EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        new_table->slots[pos].key.store(key, std::memory_order_relaxed);
+        new_table->slots[pos].value.store(s.value.load(std::memory_order_relaxed),
+                                          std::memory_order_relaxed);
+        new_table->slots[pos].state.store(FULL, std::memory_order_relaxed);
+    }
+
+    write_begin(seg);
+    if (new_table_size == old_table->table_size) {
+        for (size_t i = 0; i < new_table_size; i++) {
+            Slot &from = new_table->slots[i];
+            Slot &to = old_table->slots[i];
+            to.key.store(from.key.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to.value.store(from.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            to.state.store(from.state.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+    else {
+        seg.table.store(new_table, std::memory_order_release);
+    }
+    write_end(seg);
+
+    if (new_table_size == old_table->table_size) {
+        delete new_table;
+    }
+    else {
+        seg.retired.push_back(old_table);
+    }
+    seg.tombstones = 0;
+}
+
+template <typename K, typename V, typename Hash>
+int ConcurrentHashTable<K, V, Hash>::get(const K &key, V &value) {
+    unsigned long hash = hash_func(key);
+    Segment &seg = get_segment(hash);
+
+    for (;;) {
+        uint64_t seq = seg.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        Table *t = seg.table.load(std::memory_order_acquire);
+        unsigned long pos;
+        int probe;
+        bool found = find_slot(t, key, hash, pos, probe);
+        V v;
+        if (found) {
+            v = t->slots[pos].value.load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seg.seq.load(std::memory_order_relaxed) != seq) {
+            continue;
+        }
+        if (!found) {
+            return -1;
+        }
+        value = v;
+        return probe;
+    }
+}
+
+template <typename K, typename V, typename Hash>
+int ConcurrentHashTable<K, V, Hash>::put(const K &key, const V &value) {
+    unsigned long hash = hash_func(key);
+    Segment &seg = get_segment(hash);
+    std::lock_guard<std::mutex> guard(seg.lock);
+
+    Table *t = seg.table.load(std::memory_order_relaxed);
+    unsigned long pos;
+    int probe;
+    if (find_slot(t, key, hash, pos, probe)) {
+        return -1;
+    }
+
+    size_t size = seg.size.load(std::memory_order_relaxed);
+    uint8_t state = t->slots[pos].state.load(std::memory_order_relaxed);
+    if (state == EMPTY &&
+        size + seg.tombstones + 1 > t->table_size * CONCURRENT_MAX_USED_FACTOR) {
+        rebuild(seg, t->table_size);
+        t = seg.table.load(std::memory_order_relaxed);
+        find_slot(t, key, hash, pos, probe);
+        state = t->slots[pos].state.load(std::memory_order_relaxed);
+    }
+
+    write_begin(seg);
+    t->slots[pos].key.store(key, std::memory_order_relaxed);
+    t->slots[pos].value.store(value, std::memory_order_relaxed);
+    t->slots[pos].state.store(FULL, std::memory_order_relaxed);
+    write_end(seg);
+
+    if (state == REMOVED) {
+        seg.tombstones--;
+    }
+    seg.size.store(size + 1, std::memory_order_relaxed);
+    if (size + 1 > t->table_size * CONCURRENT_MAX_LOAD_FACTOR) {
+        rebuild(seg, t->table_size * 2);
+    }
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+int ConcurrentHashTable<K, V, Hash>::remove(const K &key) {
+    unsigned long hash = hash_func(key);
+    Segment &seg = get_segment(hash);
+    std::lock_guard<std::mutex> guard(seg.lock);
+
+    Table *t = seg.table.load(std::memory_order_relaxed);
+    unsigned long pos;
+    int probe;
+    if (!find_slot(t, key, hash, pos, probe)) {
+        return -1;
+    }
+
+    write_begin(seg);
+    t->slots[pos].state.store(REMOVED, std::memory_order_relaxed);
+    write_end(seg);
+
+    seg.tombstones++;
+    seg.size.store(seg.size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    return probe;
+}
+
+/* The sums below are not a snapshot; concurrent writers may move them */
+template <typename K, typename V, typename Hash>
+size_t ConcurrentHashTable<K, V, Hash>::get_table_size() {
+    size_t total = 0;
+    for (size_t i = 0; i < num_segments; i++) {
+        total += segments[i].table.load(std::memory_order_acquire)->table_size;
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Hash>
+size_t ConcurrentHashTable<K, V, Hash>::get_size() {
+    size_t total = 0;
+    for (size_t i = 0; i < num_segments; i++) {
+        total += segments[i].size.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Hash>
+double ConcurrentHashTable<K, V, Hash>::get_load_factor() {
+    return (double)get_size()/get_table_size();
+}
+
+#endif // __CONCURRENT_HASH_TABLE_H_
@@ -0,0 +1,423 @@
+#ifndef __CUCKOO_TABLE_H_
+#define __CUCKOO_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "hash_slot.hpp"
+#include "hash_funcs.hpp"
+
+#define CUCKOO_BUCKET_SIZE 4
+#define CUCKOO_INITIAL_TABLE_SIZE 64
+
+/* Two choices of 4-way buckets fill to about 95% before inserts start
+ * failing; growing a little earlier keeps eviction paths short. */
+#define CUCKOO_MAX_LOAD_FACTOR 0.9
+
+/* Entries that found no slot wait here until the next rehash */
+#define CUCKOO_STASH_SIZE 8
+
+/* Buckets an insert may visit while searching for an eviction path */
+#define CUCKOO_BFS_MAX_NODES 128
+
+/*
+ * Bucketized cuckoo hashing.
+ *
+ * Slots are grouped in buckets of CUCKOO_BUCKET_SIZE, and every key has
+ * exactly two candidate buckets, one per hash function. A lookup reads
+ * those two buckets and nothing else (plus the stash in the rare case
+ * that it is not empty). When a HashSlot fits in 16 bytes, e.g. an
+ * 8-byte key with a 4-byte value, a bucket is one cache line and a
+ * lookup touches at most two lines wherever the key is. The second
+ * bucket is prefetched while the first one is scanned.
+ *
+ * When both buckets of a new key are full, the insert searches breadth
+ * first for the shortest chain of entries that can each move to their
+ * other bucket, ending at a bucket with a free slot, and shifts the chain
+ * along. If no chain is found within CUCKOO_BFS_MAX_NODES buckets the
+ * entry goes to a small stash; once the stash is full the table doubles.
+ *
+ * get/remove return the number of places looked at, like the probe count
+ * of HashTable: 1 or 2 for the key's buckets, 3 for the stash. put
+ * returns 1 or 2 when the key went straight into one of its buckets,
+ * 2 + the number of entries moved when it needed an eviction path, and
+ * 3 for the stash. All three return -1 on failure.
+ */
+template <typename K, typename V, typename Hash = VirtualHash>
+class CuckooHashTable {
+public:
+    CuckooHashTable(Hash hash_func = Hash());
+    ~CuckooHashTable();
+    int get(const K &key, V &value);
+    int put(const K &key, const V &value);
+    int remove(const K &key);
+    size_t get_table_size();
+    size_t get_size();
+    size_t get_stash_size();
+    double get_load_factor();
+
+private:
+    /* Small buckets are padded out to a cache line, so a bucket never
+     * straddles two lines */
+    struct alignas(64) Bucket {
+        HashSlot<K, V> slots[CUCKOO_BUCKET_SIZE];
+    };
+
+    /* One bucket reached by the eviction search: the entry in slot
+     * `slot' of the parent node's bucket would move into `bucket' */
+    struct BfsNode {
+        size_t bucket;
+        int parent;
+        int slot;
+    };
+
+    Hash hash_func;
+    size_t bucket_count;
+    size_t size;
+    Bucket *buckets;
+    HashSlot<K, V> stash[CUCKOO_STASH_SIZE];
+    size_t stash_size;
+
+    void get_buckets(const K &key, size_t &b1, size_t &b2);
+    int find_in_bucket(size_t b, const K &key);
+    int find_free(size_t b);
+    int find_in_stash(const K &key);
+    bool find_path(size_t b1, size_t b2, size_t &root, int &slot, int &moves);
+    int insert_new(K &key, V &value);
+    void move_slot(HashSlot<K, V> &from, HashSlot<K, V> &to);
+    void drain_stash();
+    void rehash(size_t new_bucket_count);
+
+    // disallow copy and assignment
+    CuckooHashTable(const CuckooHashTable &);
+    CuckooHashTable & operator=(const CuckooHashTable &);
+};
+
+template <typename K, typename V, typename Hash>
+CuckooHashTable<K, V, Hash>::CuckooHashTable(Hash hash_func)
+    : hash_func(hash_func), bucket_count(CUCKOO_INITIAL_TABLE_SIZE / CUCKOO_BUCKET_SIZE),
+      size(0), stash_size(0) {
+    buckets = new Bucket[bucket_count];
+}
+
+template <typename K, typename V, typename Hash>
+CuckooHashTable<K, V, Hash>::~CuckooHashTable() {
+    delete[] buckets;
+}
+
+/* The two bucket indices come from two independent mixes of the policy's
+ * hash, which may be as weak as the identity function. A key whose two
+ * indices collide uses the neighbouring bucket as its second one. */
+template <typename K, typename V, typename Hash>
+void CuckooHashTable<K, V, Hash>::get_buckets(const K &key, size_t &b1, size_t &b2) {
+    uint64_t h = hash_func(key);
+    b1 = wy::mix(h ^ wy::P0, wy::P1) & (bucket_count - 1);
+    b2 = wy::mix(h ^ wy::P2, wy::P3) & (bucket_count - 1);
+    if (b2 == b1) {
+        b2 = b1 ^ 1;
+    }
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::find_in_bucket(size_t b, const K &key) {
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++) {
+        if (!buckets[b].slots[i].is_empty() && buckets[b].slots[i].get_key() == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::find_free(size_t b) {
+    for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++) {
+        if (buckets[b].slots[i].is_empty()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::find_in_stash(const K &key) {
+    for (size_t i = 0; i < stash_size; i++) {
+        if (stash[i].get_key() == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <typename K, typename V, typename Hash>
+void CuckooHashTable<K, V, Hash>::move_slot(HashSlot<K, V> &from, HashSlot<K, V> &to) {
+    to.emplace(std::move(from.get_key()), std::move(from.get_value()));
+    from.set_empty();
+}
+
+/*
+ * Breadth-first search for an eviction path out of the full buckets b1
+ * and b2. Every bucket is visited at most once, so the entries on the
+ * path are distinct and moving them from the far end back toward the
+ * root never overwrites one another. On success, slot `slot' of bucket
+ * `root' has been emptied and `moves' entries were shifted.
+ */
+template <typename K, typename V, typename Hash>
+bool CuckooHashTable<K, V, Hash>::find_path(size_t b1, size_t b2, size_t &root,
+                                            int &slot, int &moves) {
+    BfsNode nodes[CUCKOO_BFS_MAX_NODES];
+    int count = 0;
+    nodes[count++] = {b1, -1, -1};
+    nodes[count++] = {b2, -1, -1};
+
+    for (int n = 0; n < count; n++) {
+        size_t b = nodes[n].bucket;
+        for (int s = 0; s < CUCKOO_BUCKET_SIZE; s++) {
+            size_t k1, k2;
+            get_buckets(buckets[b].slots[s].get_key(), k1, k2);
+            size_t alt = k1 == b ? k2 : k1;
+
+            int free_slot = find_free(alt);
+            if (free_slot != -1) {
+                // shift the chain, starting from the end with the free slot
+                move_slot(buckets[b].slots[s], buckets[alt].slots[free_slot]);
+                moves = 1;
+                int cur = n;
+                for (; nodes[cur].parent != -1; cur = nodes[cur].parent) {
+                    size_t from = nodes[nodes[cur].parent].bucket;
+                    move_slot(buckets[from].slots[nodes[cur].slot],
+                              buckets[nodes[cur].bucket].slots[s]);
+                    s = nodes[cur].slot;
+                    moves++;
+                }
+                root = nodes[cur].bucket;
+                slot = s;
+                return true;
+            }
+
+            if (count == CUCKOO_BFS_MAX_NODES) {
+                continue;
+            }
+            bool seen = false;
+            for (int i = 0; i < count && !seen; i++) {
+                seen = nodes[i].bucket == alt;
+            }
+            if (!seen) {
+                nodes[count++] = {alt, n, s};
+            }
+        }
+    }
+    return false;
+}
+
+/* Place a key known to be absent. `key' and `value' are only moved from
+ * if the entry was placed; -1 means the table and the stash are full. */
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::insert_new(K &key, V &value) {
+    size_t b1, b2, root;
+    int slot, moves;
+    get_buckets(key, b1, b2);
+
+    if ((slot = find_free(b1)) != -1) {
+        buckets[b1].slots[slot].emplace(std::move(key), std::move(value));
+        return 1;
+    }
+    if ((slot = find_free(b2)) != -1) {
+        buckets[b2].slots[slot].emplace(std::move(key), std::move(value));
+        return 2;
+    }
+    if (find_path(b1, b2, root, slot, moves)) {
+        buckets[root].slots[slot].emplace(std::move(key), std::move(value));
+        return 2 + moves;
+    }
+    if (stash_size < CUCKOO_STASH_SIZE) {
+        stash[stash_size++].emplace(std::move(key), std::move(value));
+        return 3;
+    }
+    return -1;
+}
+
+/* Move stashed entries back into their buckets where a slot has freed */
+template <typename K, typename V, typename Hash>
+void CuckooHashTable<K, V, Hash>::drain_stash() {
+    for (size_t i = 0; i < stash_size; ) {
+        size_t b1, b2;
+        get_buckets(stash[i].get_key(), b1, b2);
+        int slot;
+        size_t b = b1;
+        if ((slot = find_free(b1)) == -1) {
+            b = b2;
+            slot = find_free(b2);
+        }
+        if (slot == -1) {
+            i++;
+            continue;
+        }
+        move_slot(stash[i], buckets[b].slots[slot]);
+        stash_size--;
+        if (i != stash_size) {
+            move_slot(stash[stash_size], stash[i]);
+        }
+    }
+}
+
+/* Entries are moved out first, so that a rehash that itself runs out of
+ * room can simply start over with twice the buckets. */
+template <typename K, typename V, typename Hash>
+void CuckooHashTable<K, V, Hash>::rehash(size_t new_bucket_count) {
+    std::vector<std::pair<K, V> > entries;
+    entries.reserve(size);
+    for (size_t b = 0; b < bucket_count; b++) {
+        for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++) {
+            HashSlot<K, V> &s = buckets[b].slots[i];
+            if (!s.is_empty()) {
+                entries.emplace_back(std::move(s.get_key()), std::move(s.get_value()));
+            }
+        }
+    }
+    for (size_t i = 0; i < stash_size; i++) {
+        entries.emplace_back(std::move(stash[i].get_key()), std::move(stash[i].get_value()));
+        stash[i].set_empty();
+    }
+    stash_size = 0;
+
+    for (;;) {
+        delete[] buckets;
+        bucket_count = new_bucket_count;
+        buckets = new Bucket[bucket_count];
+
+        size_t placed = 0;
+        while (placed < entries.size() &&
+               insert_new(entries[placed].first, entries[placed].second) != -1) {
+            placed++;
+        }
+        if (placed == entries.size()) {
+            return;
+        }
+
+        // take back what was placed and try again, twice as large
+        std::vector<std::pair<K, V> > retry;
+        retry.reserve(entries.size());
+        for (size_t b = 0; b < bucket_count; b++) {
+            for (int i = 0; i < CUCKOO_BUCKET_SIZE; i++) {
+                HashSlot<K, V> &s = buckets[b].slots[i];
+                if (!s.is_empty()) {
+                    retry.emplace_back(std::move(s.get_key()), std::move(s.get_value()));
+                }
+            }
+        }
+        for (size_t i = 0; i < stash_size; i++) {
+            retry.emplace_back(std::move(stash[i].get_key()), std::move(stash[i].get_value()));
+            stash[i].set_empty();
+        }
+        stash_size = 0;
+        for (size_t i = placed; i < entries.size(); i++) {
+            retry.push_back(std::move(entries[i]));
+        }
+        entries.swap(retry);
+        new_bucket_count *= 2;
+    }
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::get(const K &key, V &value) {
+    size_t b1, b2;
+    int slot;
+    get_buckets(key, b1, b2);
+    __builtin_prefetch(&buckets[b2]);
+
+    if ((slot = find_in_bucket(b1, key)) != -1) {
+        value = buckets[b1].slots[slot].get_value();
+        return 1;
+    }
+    if ((slot = find_in_bucket(b2, key)) != -1) {
+        value = buckets[b2].slots[slot].get_value();
+        return 2;
+    }
+    if (stash_size != 0 && (slot = find_in_stash(key)) != -1) {
+        value = stash[slot].get_value();
+        return 3;
+    }
+    return -1;
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::put(const K &key, const V &value) {
+    size_t b1, b2;
+    get_buckets(key, b1, b2);
+    if (find_in_bucket(b1, key) != -1 || find_in_bucket(b2, key) != -1 ||
+        (stash_size != 0 && find_in_stash(key) != -1)) {
+        return -1;
+    }
+
+    if (size + 1 > bucket_count * CUCKOO_BUCKET_SIZE * CUCKOO_MAX_LOAD_FACTOR) {
+        rehash(bucket_count * 2);
+    }
+
+    K k = key;
+    V v = value;
+    int probe;
+    while ((probe = insert_new(k, v)) == -1) {
+        rehash(bucket_count * 2);
+    }
+    size++;
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+int CuckooHashTable<K, V, Hash>::remove(const K &key) {
+    size_t b1, b2;
+    int slot, probe;
+    get_buckets(key, b1, b2);
+
+    if ((slot = find_in_bucket(b1, key)) != -1) {
+        buckets[b1].slots[slot].set_empty();
+        probe = 1;
+    }
+    else if ((slot = find_in_bucket(b2, key)) != -1) {
+        buckets[b2].slots[slot].set_empty();
+        probe = 2;
+    }
+    else if (stash_size != 0 && (slot = find_in_stash(key)) != -1) {
+        stash_size--;
+        if ((size_t)slot != stash_size) {
+            move_slot(stash[stash_size], stash[slot]);
+        }
+        else {
+            stash[slot].set_empty();
+        }
+        probe = 3;
+    }
+    else {
+        return -1;
+    }
+
+    size--;
+    if (stash_size != 0) {
+        drain_stash();
+    }
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+size_t CuckooHashTable<K, V, Hash>::get_table_size() {
+    return bucket_count * CUCKOO_BUCKET_SIZE;
+}
+
+template <typename K, typename V, typename Hash>
+size_t CuckooHashTable<K, V, Hash>::get_size() {
+    return size;
+}
+
+template <typename K, typename V, typename Hash>
+size_t CuckooHashTable<K, V, Hash>::get_stash_size() {
+    return stash_size;
+}
+
+template <typename K, typename V, typename Hash>
+double CuckooHashTable<K, V, Hash>::get_load_factor() {
+    return (double)size/get_table_size();
+}
+
+#endif // __CUCKOO_TABLE_H_
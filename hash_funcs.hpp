@@ -0,0 +1,152 @@
+#ifndef __HASH_FUNCS_H_
+#define __HASH_FUNCS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/*
+ * Hash functions for the hash tables in this directory.
+ *
+ * Tables take their hash function as a template policy: any copyable
+ * type with `unsigned long operator()(const K &) const'. Being a template
+ * argument, the call can be inlined into the probe loop. VirtualHash is
+ * the default policy and wraps the classic HashFunc interface, so tables
+ * can still be built from a HashFunc pointer. A default-constructed
+ * VirtualHash uses a shared NaiveHashFunc.
+ *
+ * A policy's `id' is recorded in table snapshots (see hash_snapshot.hpp)
+ * so that a file is never served through a different hash. Policies
+ * without one cannot be saved.
+ */
+
+class HashFunc {
+public:
+    virtual ~HashFunc() = default;
+    virtual unsigned long hash(const int key) = 0;
+};
+
+class NaiveHashFunc: public HashFunc {
+public:
+    unsigned long hash(const int key) {
+        return key;
+    }
+};
+
+struct VirtualHash {
+    static constexpr uint32_t id = 1;
+
+    HashFunc *hash_func;
+
+    VirtualHash(): hash_func(naive()) {
+    }
+
+    VirtualHash(HashFunc *hash_func): hash_func(hash_func) {
+    }
+
+    template <typename K>
+    unsigned long operator()(const K &key) const {
+        return hash_func->hash(key);
+    }
+
+private:
+    static HashFunc *naive() {
+        static NaiveHashFunc instance;
+        return &instance;
+    }
+};
+
+/* Mixing primitives from wyhash (https://github.com/wangyi-fudan/wyhash) */
+namespace wy {
+    constexpr uint64_t P0 = 0xa0761d6478bd642full;
+    constexpr uint64_t P1 = 0xe7037ed1a0b428dbull;
+    constexpr uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+    constexpr uint64_t P3 = 0x589965cc75374cc3ull;
+
+    /* 64x64 -> 128 bit multiply, folded back to 64 bits */
+    inline uint64_t mix(uint64_t a, uint64_t b) {
+        __uint128_t r = (__uint128_t)a * b;
+        return (uint64_t)r ^ (uint64_t)(r >> 64);
+    }
+
+    inline uint64_t read8(const uint8_t *p) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint64_t read4(const uint8_t *p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+
+    /* Reads 1 to 3 bytes without branching on the exact length */
+    inline uint64_t read3(const uint8_t *p, size_t k) {
+        return ((uint64_t)p[0] << 16) | ((uint64_t)p[k >> 1] << 8) | p[k - 1];
+    }
+
+    inline uint64_t hash_bytes(const void *key, size_t len, uint64_t seed = 0) {
+        const uint8_t *p = static_cast<const uint8_t *>(key);
+        uint64_t a, b;
+
+        seed ^= mix(seed ^ P0, P1);
+        if (len <= 16) {
+            if (len >= 4) {
+                a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+                b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+            }
+            else if (len > 0) {
+                a = read3(p, len);
+                b = 0;
+            }
+            else {
+                a = b = 0;
+            }
+        }
+        else {
+            size_t i = len;
+            if (i > 48) {
+                uint64_t seed1 = seed, seed2 = seed;
+                do {
+                    seed = mix(read8(p) ^ P1, read8(p + 8) ^ seed);
+                    seed1 = mix(read8(p + 16) ^ P2, read8(p + 24) ^ seed1);
+                    seed2 = mix(read8(p + 32) ^ P3, read8(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                } while (i > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (i > 16) {
+                seed = mix(read8(p) ^ P1, read8(p + 8) ^ seed);
+                p += 16;
+                i -= 16;
+            }
+            a = read8(p + i - 16);
+            b = read8(p + i - 8);
+        }
+
+        __uint128_t r = (__uint128_t)(a ^ P1) * (b ^ seed);
+        return mix((uint64_t)r ^ P0 ^ len, (uint64_t)(r >> 64) ^ P1);
+    }
+}
+
+/*
+ * Fast, well-mixed hashes for integer and string keys. Unlike
+ * NaiveHashFunc every output bit depends on every input bit, so masking
+ * off the low bits of the hash gives a good slot index.
+ */
+struct FastHash {
+    static constexpr uint32_t id = 2;
+
+    unsigned long operator()(uint64_t key) const {
+        return wy::mix(key ^ wy::P0, wy::P1);
+    }
+
+    unsigned long operator()(const std::string &key) const {
+        return wy::hash_bytes(key.data(), key.size());
+    }
+};
+
+#endif // __HASH_FUNCS_H_
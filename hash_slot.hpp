@@ -1,59 +1,394 @@
-#include <cstddef>
+#ifndef __HASH_SLOT_H_
+#define __HASH_SLOT_H_
 
-/* Fill in the TODO sections in the following code. */
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
+/*
+ * One key-value slot. The key and value live in raw storage and are only
+ * constructed while the slot is full, so an empty slot never runs K's or
+ * V's constructors and clearing a slot destroys its contents.
+ */
 template <typename K, typename V>
 class HashSlot
 {
 public:
-    HashSlot(): _empty(true), _removed(false) {
+    HashSlot(): _empty(true), _removed(false), _dist(0) {
+    }
+
+    ~HashSlot() {
+        clear();
     }
     
-    K get_key() const {
-        return _key;
+    const K &get_key() const {
+        return *std::launder(reinterpret_cast<const K *>(_key));
     }
 
-    V get_value() const {
-        return _value;
+    K &get_key() {
+        return *std::launder(reinterpret_cast<K *>(_key));
     }
 
-    void set_key_value(K key, V value) {
-        // TODO
-        _key = key;
-        _value = value;
+    const V &get_value() const {
+        return *std::launder(reinterpret_cast<const V *>(_value));
+    }
+
+    V &get_value() {
+        return *std::launder(reinterpret_cast<V *>(_value));
+    }
+
+    /* Construct the key from `key' and the value from `args' in place,
+     * replacing whatever the slot held before */
+    template <typename KK, typename... Args>
+    void emplace(KK &&key, Args &&...args) {
+        clear();
+        new (_key) K(std::forward<KK>(key));
+        new (_value) V(std::forward<Args>(args)...);
         _removed = false;
         _empty = false;
     }
 
+    template <typename KK, typename VV>
+    void set_key_value(KK &&key, VV &&value) {
+        emplace(std::forward<KK>(key), std::forward<VV>(value));
+    }
+
     bool is_empty() const {
-        //TODO
         return _empty;
     }
 
     void set_empty() {
-        //TODO
-        _empty = true;       
+        clear();
+        _empty = true;
     }
 
     bool is_removed() const {
-        //TODO
         return _removed;
     }
 
     void set_removed() {
-        //TODO
+        clear();
         _empty = true;
         _removed = true;
     }
+
+    /* Distance from the key's home slot. Only kept up to date by tables
+     * that use it, such as RobinHoodHashTable. */
+    uint16_t get_dist() const {
+        return _dist;
+    }
+
+    void set_dist(uint16_t dist) {
+        _dist = dist;
+    }
     
 private:
-    // key-value pair
-    K _key;
-    V _value;
+    // key-value pair, constructed only while the slot is full
+    alignas(K) unsigned char _key[sizeof(K)];
+    alignas(V) unsigned char _value[sizeof(V)];
     bool _empty;
     bool _removed;
+    // fits in the padding after the two flags for small K and V
+    uint16_t _dist;
+
+    void clear() {
+        if (!_empty) {
+            get_key().~K();
+            get_value().~V();
+        }
+    }
 
     // disallow copy and assignment
     HashSlot(const HashSlot &);
     HashSlot & operator=(const HashSlot &);
 };
+
+/*
+ * Slot storage layouts for HashTable. A layout owns the slots of one
+ * table and exposes per-index accessors, so the probing code does not
+ * depend on how slots are laid out in memory.
+ */
+
+/*
+ * Shrink the malloc'd block `block' of `size' bytes by up to `bytes',
+ * freeing it once no more than `bytes' are left, and return the new
+ * size. Giving back a huge block in steps spreads the cost of unmapping
+ * its pages over many calls. An allocator that moves the block rather
+ * than trimming it gets the whole block freed at once instead.
+ */
+template <typename T>
+size_t release_block(T *&block, size_t size, size_t bytes) {
+    if (size > bytes) {
+        void *shrunk = std::realloc(static_cast<void *>(block), size - bytes);
+        if (shrunk == block) {
+            return size - bytes;
+        }
+        if (shrunk != nullptr) {
+            block = static_cast<T *>(shrunk);
+        }
+    }
+    std::free(block);
+    block = nullptr;
+    return 0;
+}
+
+/*
+ * Array of slot structs: key, value and state share a cache line. A slot
+ * is plain bytes whose all-zero state is EMPTY, so the array comes
+ * straight from calloc and nothing is constructed up front; calloc hands
+ * out large blocks as untouched zero pages, so setting up even a huge
+ * table costs no more than the page faults its writes take later.
+ */
+template <typename K, typename V>
+class SlotArray
+{
+public:
+    SlotArray(size_t n): _slots(static_cast<Slot *>(std::calloc(n, sizeof(Slot)))),
+                         _n(n), _bytes(n * sizeof(Slot)) {
+    }
+
+    ~SlotArray() {
+        if (!std::is_trivially_destructible<K>::value ||
+            !std::is_trivially_destructible<V>::value) {
+            for (size_t i = 0; i < _n; i++) {
+                clear(i);
+            }
+        }
+        std::free(_slots);
+    }
+
+    bool is_empty(size_t i) const {
+        return _slots[i].state != FULL;
+    }
+
+    bool is_removed(size_t i) const {
+        return _slots[i].state == REMOVED;
+    }
+
+    const K &get_key(size_t i) const {
+        return *std::launder(reinterpret_cast<const K *>(_slots[i].key));
+    }
+
+    V &get_value(size_t i) {
+        return *std::launder(reinterpret_cast<V *>(_slots[i].value));
+    }
+
+    /* Move the entry out, e.g. during a rehash. The slot still has to be
+     * cleared with set_removed() afterwards. */
+    K &&take_key(size_t i) {
+        return std::move(*std::launder(reinterpret_cast<K *>(_slots[i].key)));
+    }
+
+    V &&take_value(size_t i) {
+        return std::move(get_value(i));
+    }
+
+    template <typename KK, typename... Args>
+    void emplace(size_t i, KK &&key, Args &&...args) {
+        clear(i);
+        new (_slots[i].key) K(std::forward<KK>(key));
+        new (_slots[i].value) V(std::forward<Args>(args)...);
+        _slots[i].state = FULL;
+    }
+
+    void set_removed(size_t i) {
+        clear(i);
+        _slots[i].state = REMOVED;
+    }
+
+    void prefetch(size_t i) const {
+        __builtin_prefetch(&_slots[i]);
+    }
+
+    /* Give the memory of a drained table back, at most `bytes' per call.
+     * Every slot must already be empty or removed, and no slot may be
+     * used after the first call. Returns true once all of it is freed. */
+    bool release(size_t bytes) {
+        _n = 0;
+        _bytes = release_block(_slots, _bytes, bytes);
+        return _bytes == 0;
+    }
+
+    void swap(SlotArray &other) {
+        std::swap(_slots, other._slots);
+        std::swap(_n, other._n);
+        std::swap(_bytes, other._bytes);
+    }
+
+private:
+    // EMPTY is zero so that zeroed memory is an array of empty slots
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t FULL = 1;
+    static constexpr uint8_t REMOVED = 2;
+
+    struct Slot {
+        // key-value pair, constructed only while the slot is full
+        alignas(K) unsigned char key[sizeof(K)];
+        alignas(V) unsigned char value[sizeof(V)];
+        uint8_t state;
+    };
+    static_assert(alignof(Slot) <= alignof(std::max_align_t),
+                  "slots are allocated with calloc");
+
+    Slot *_slots;
+    size_t _n;
+    size_t _bytes;
+
+    void clear(size_t i) {
+        if (_slots[i].state == FULL) {
+            reinterpret_cast<K *>(_slots[i].key)->~K();
+            get_value(i).~V();
+        }
+    }
+
+    // disallow copy and assignment
+    SlotArray(const SlotArray &);
+    SlotArray & operator=(const SlotArray &);
+};
+
+/*
+ * Structure of arrays: keys, values and states live in separate arrays.
+ * A probe only reads the state array and the key array; values are
+ * touched once the key matches. States take two bits per slot, four
+ * slots to a byte, so the state array of a whole table is small enough
+ * to stay cached.
+ */
+template <typename K, typename V>
+class SplitSlotArray
+{
+public:
+    /* Keys and values are left unconstructed until a slot fills, and
+     * calloc hands out large blocks as untouched zero pages, so setting
+     * up even a huge table costs no more than the page faults its
+     * writes take later. */
+    SplitSlotArray(size_t n): _keys(static_cast<K *>(std::malloc(n * sizeof(K)))),
+                              _values(static_cast<V *>(std::malloc(n * sizeof(V)))),
+                              _states(static_cast<uint8_t *>(std::calloc((n + 3) / 4, 1))),
+                              _n(n), _key_bytes(n * sizeof(K)),
+                              _value_bytes(n * sizeof(V)), _state_bytes((n + 3) / 4) {
+    }
+
+    ~SplitSlotArray() {
+        if (!std::is_trivially_destructible<K>::value ||
+            !std::is_trivially_destructible<V>::value) {
+            for (size_t i = 0; i < _n; i++) {
+                clear(i);
+            }
+        }
+        std::free(_keys);
+        std::free(_values);
+        std::free(_states);
+    }
+
+    bool is_empty(size_t i) const {
+        return get_state(i) != FULL;
+    }
+
+    bool is_removed(size_t i) const {
+        return get_state(i) == REMOVED;
+    }
+
+    const K &get_key(size_t i) const {
+        return _keys[i];
+    }
+
+    V &get_value(size_t i) {
+        return _values[i];
+    }
+
+    K &&take_key(size_t i) {
+        return std::move(_keys[i]);
+    }
+
+    V &&take_value(size_t i) {
+        return std::move(_values[i]);
+    }
+
+    template <typename KK, typename... Args>
+    void emplace(size_t i, KK &&key, Args &&...args) {
+        clear(i);
+        new (&_keys[i]) K(std::forward<KK>(key));
+        new (&_values[i]) V(std::forward<Args>(args)...);
+        set_state(i, FULL);
+    }
+
+    void set_removed(size_t i) {
+        clear(i);
+        set_state(i, REMOVED);
+    }
+
+    void prefetch(size_t i) const {
+        __builtin_prefetch(&_states[i / 4]);
+        __builtin_prefetch(&_keys[i]);
+    }
+
+    /* Same contract as SlotArray::release(); the key array goes first,
+     * then the values, then the states. */
+    bool release(size_t bytes) {
+        _n = 0;
+        if (_key_bytes != 0) {
+            _key_bytes = release_block(_keys, _key_bytes, bytes);
+        }
+        else if (_value_bytes != 0) {
+            _value_bytes = release_block(_values, _value_bytes, bytes);
+        }
+        else {
+            _state_bytes = release_block(_states, _state_bytes, bytes);
+        }
+        return _key_bytes == 0 && _value_bytes == 0 && _state_bytes == 0;
+    }
+
+    void swap(SplitSlotArray &other) {
+        std::swap(_keys, other._keys);
+        std::swap(_values, other._values);
+        std::swap(_states, other._states);
+        std::swap(_n, other._n);
+        std::swap(_key_bytes, other._key_bytes);
+        std::swap(_value_bytes, other._value_bytes);
+        std::swap(_state_bytes, other._state_bytes);
+    }
+
+private:
+    // EMPTY is zero so that a value-initialized state array is all empty
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t FULL = 1;
+    static constexpr uint8_t REMOVED = 2;
+
+    static_assert(alignof(K) <= alignof(std::max_align_t) &&
+                  alignof(V) <= alignof(std::max_align_t),
+                  "keys and values are allocated with malloc");
+
+    K *_keys;
+    V *_values;
+    uint8_t *_states;
+    size_t _n;
+    size_t _key_bytes;
+    size_t _value_bytes;
+    size_t _state_bytes;
+
+    uint8_t get_state(size_t i) const {
+        return (_states[i / 4] >> (i % 4 * 2)) & 3;
+    }
+
+    void set_state(size_t i, uint8_t state) {
+        uint8_t shift = i % 4 * 2;
+        _states[i / 4] = (_states[i / 4] & ~(3 << shift)) | (state << shift);
+    }
+
+    void clear(size_t i) {
+        if (get_state(i) == FULL) {
+            _keys[i].~K();
+            _values[i].~V();
+        }
+    }
+
+    // disallow copy and assignment
+    SplitSlotArray(const SplitSlotArray &);
+    SplitSlotArray & operator=(const SplitSlotArray &);
+};
+
+#endif // __HASH_SLOT_H_
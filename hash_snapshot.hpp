@@ -0,0 +1,403 @@
+#ifndef __HASH_SNAPSHOT_H_
+#define __HASH_SNAPSHOT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_funcs.hpp"
+#include "hash_table.hpp"
+
+/*
+ * On-disk snapshot of an open-addressing HashTable.
+ *
+ * Snapshots are opt-in: hash_table.hpp does not include this header, so
+ * only code that saves or serves snapshots depends on the POSIX mapping
+ * calls used here.
+ *
+ * The file is the table itself: a fixed header, then one state byte per
+ * slot, then the key array and the value array, each aligned for its
+ * type and indexed by slot position. Written by save_snapshot() and
+ * served in place by HashTableSnapshot, which maps the file and probes
+ * it without deserializing anything.
+ *
+ * Only trivially copyable keys and values can be stored. The payload is
+ * in native byte order, and the header records the byte order, the key
+ * and value sizes and the probing and hash policies so that a mismatched
+ * reader is rejected rather than served garbage. A VirtualHash id cannot
+ * tell two HashFuncs apart, so the header also keeps the full hash of one
+ * stored key, which the reader recomputes. The checksum is wyhash chained
+ * over SNAPSHOT_BLOCK_SIZE blocks of the payload.
+ */
+
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_SIZE 128
+#define SNAPSHOT_BLOCK_SIZE (64 * 1024)
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t probe_id;
+    uint32_t hash_id;
+    uint16_t key_size;
+    uint16_t value_size;
+    uint64_t table_size;
+    uint64_t size;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+    uint64_t check_slot;    // a full slot, if size != 0
+    uint64_t check_hash;    // full hash of the key in check_slot
+    uint64_t checksum;
+
+    static constexpr const char *MAGIC = "HTSNAP\0";
+    static constexpr uint32_t ENDIAN_TAG = 0x01020304;
+
+    static size_t align(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+};
+
+static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_HEADER_SIZE,
+              "snapshot header does not fit its reserved space");
+
+/* The snapshot id of hash policy `Hash', 0 if it has none */
+template <typename Hash, typename = void>
+struct SnapshotHashId {
+    static constexpr uint32_t value = 0;
+};
+
+template <typename Hash>
+struct SnapshotHashId<Hash, decltype((void)Hash::id)> {
+    static constexpr uint32_t value = Hash::id;
+};
+
+/* Slot states as stored in the snapshot */
+enum SnapshotSlot : uint8_t { SNAPSHOT_EMPTY = 0, SNAPSHOT_FULL = 1, SNAPSHOT_REMOVED = 2 };
+
+/* Streams the payload to disk block by block, checksumming each block
+ * as it goes, then goes back and fills in the header. */
+class SnapshotWriter {
+public:
+    SnapshotWriter(const std::string &path)
+        : out(path, std::ios::binary | std::ios::trunc),
+          block(new char[SNAPSHOT_BLOCK_SIZE]), offset(SNAPSHOT_HEADER_SIZE),
+          used(0), checksum(0) {
+        char zero[SNAPSHOT_HEADER_SIZE] = {};
+        out.write(zero, sizeof(zero));
+    }
+
+    bool good() const {
+        return out.good();
+    }
+
+    size_t get_offset() const {
+        return offset;
+    }
+
+    void append(const void *data, size_t len) {
+        const char *p = static_cast<const char *>(data);
+        while (len > 0) {
+            size_t n = std::min(len, (size_t)SNAPSHOT_BLOCK_SIZE - used);
+            std::memcpy(block.get() + used, p, n);
+            used += n;
+            offset += n;
+            p += n;
+            len -= n;
+            if (used == SNAPSHOT_BLOCK_SIZE) {
+                flush();
+            }
+        }
+    }
+
+    void append_zero(size_t len) {
+        static const char zero[64] = {};
+        while (len > 0) {
+            size_t n = std::min(len, sizeof(zero));
+            append(zero, n);
+            len -= n;
+        }
+    }
+
+    void pad_to(size_t alignment) {
+        append_zero(SnapshotHeader::align(offset, alignment) - offset);
+    }
+
+    bool finish(SnapshotHeader &header) {
+        flush();
+        std::memcpy(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byte_order = SnapshotHeader::ENDIAN_TAG;
+        header.checksum = checksum;
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    std::ofstream out;
+    std::unique_ptr<char[]> block;
+    size_t offset;
+    size_t used;
+    uint64_t checksum;
+
+    void flush() {
+        if (used == 0) {
+            return;
+        }
+        checksum = wy::hash_bytes(block.get(), used, checksum);
+        out.write(block.get(), used);
+        used = 0;
+    }
+};
+
+/*
+ * Write `t' to `path' in the format read by HashTableSnapshot. A pending
+ * incremental resize is finished first. Returns false if the file cannot
+ * be written or the table's probing or hash policy has no snapshot id.
+ *
+ * Slots are written at their current positions, tombstones included, so
+ * the reader's probe chains are exactly the table's. The key and value
+ * bytes of slots that are not full are written as zeros. */
+template <typename K, typename V, typename Hash, typename Layout>
+bool save_snapshot(HashTable<K, V, Hash, Layout> &t, const std::string &path) {
+    static_assert(std::is_trivially_copyable<K>::value &&
+                  std::is_trivially_copyable<V>::value,
+                  "snapshots need trivially copyable keys and values");
+
+    uint32_t probe_id = t.get_probe_id();
+    uint32_t hash_id = SnapshotHashId<Hash>::value;
+    if (probe_id == 0 || hash_id == 0) {
+        return false;
+    }
+    t.rehash_step(t.old_table_size);
+
+    SnapshotWriter out(path);
+    if (!out.good()) {
+        return false;
+    }
+    for (size_t i = 0; i < t.table_size; i++) {
+        uint8_t state = !t.table.is_empty(i) ? SNAPSHOT_FULL
+                        : t.table.is_removed(i) ? SNAPSHOT_REMOVED : SNAPSHOT_EMPTY;
+        out.append(&state, 1);
+    }
+
+    SnapshotHeader header;
+    header.check_slot = 0;
+    header.check_hash = 0;
+    out.pad_to(alignof(K));
+    header.keys_offset = out.get_offset();
+    for (size_t i = 0; i < t.table_size; i++) {
+        if (t.table.is_empty(i)) {
+            out.append_zero(sizeof(K));
+        }
+        else {
+            out.append(&t.table.get_key(i), sizeof(K));
+            // Zero is a fixed point of many hashes, so skip keys hashing to it
+            if (header.check_hash == 0) {
+                header.check_slot = i;
+                header.check_hash = t.hash_func(t.table.get_key(i));
+            }
+        }
+    }
+    out.pad_to(alignof(V));
+    header.values_offset = out.get_offset();
+    for (size_t i = 0; i < t.table_size; i++) {
+        if (t.table.is_empty(i)) {
+            out.append_zero(sizeof(V));
+        }
+        else {
+            out.append(&t.table.get_value(i), sizeof(V));
+        }
+    }
+
+    header.probe_id = probe_id;
+    header.hash_id = hash_id;
+    header.key_size = sizeof(K);
+    header.value_size = sizeof(V);
+    header.table_size = t.table_size;
+    header.size = t.size;
+    return out.finish(header);
+}
+
+/*
+ * Read-only view of a snapshot file. open() maps the file and get() runs
+ * straight against the mapping, so a restart costs one mmap (plus one
+ * read pass if the checksum is verified) instead of re-inserting every
+ * entry. `Probe' and `Hash' must be the probing policy and hash function
+ * of the table that wrote the file.
+ */
+template <typename K, typename V, typename Probe, typename Hash = VirtualHash>
+class HashTableSnapshot {
+    static_assert(std::is_trivially_copyable<K>::value &&
+                  std::is_trivially_copyable<V>::value,
+                  "snapshots need trivially copyable keys and values");
+
+public:
+    HashTableSnapshot(Hash hash_func = Hash());
+    ~HashTableSnapshot();
+
+    /* Map `path'. Returns false if the file is missing, was written for a
+     * different table type, hash or version, or fails its checksum. */
+    bool open(const std::string &path, bool verify_checksum = true);
+    void close();
+
+    int get(const K &key, V &value) const;
+    size_t get_table_size() const;
+    size_t get_size() const;
+    double get_load_factor() const;
+
+private:
+    Hash hash_func;
+    void *map;
+    size_t map_size;
+    size_t table_size;
+    size_t size;
+    const uint8_t *states;
+    const K *keys;
+    const V *values;
+
+    // disallow copy and assignment
+    HashTableSnapshot(const HashTableSnapshot &);
+    HashTableSnapshot & operator=(const HashTableSnapshot &);
+};
+
+template <typename K, typename V, typename Probe, typename Hash>
+HashTableSnapshot<K, V, Probe, Hash>::HashTableSnapshot(Hash hash_func)
+    : hash_func(hash_func), map(nullptr), map_size(0), table_size(0), size(0),
+      states(nullptr), keys(nullptr), values(nullptr) {
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+HashTableSnapshot<K, V, Probe, Hash>::~HashTableSnapshot() {
+    close();
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+bool HashTableSnapshot<K, V, Probe, Hash>::open(const std::string &path, bool verify_checksum) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < SNAPSHOT_HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+    map = m;
+    map_size = st.st_size;
+
+    SnapshotHeader h;
+    std::memcpy(&h, map, sizeof(h));
+    size_t keys_offset = SnapshotHeader::align(SNAPSHOT_HEADER_SIZE + h.table_size, alignof(K));
+    size_t values_offset = SnapshotHeader::align(keys_offset + h.table_size * sizeof(K), alignof(V));
+    bool valid = std::memcmp(h.magic, SnapshotHeader::MAGIC, sizeof(h.magic)) == 0 &&
+                 h.version == SNAPSHOT_VERSION &&
+                 h.byte_order == SnapshotHeader::ENDIAN_TAG &&
+                 h.probe_id == Probe::id &&
+                 h.hash_id == SnapshotHashId<Hash>::value && h.hash_id != 0 &&
+                 h.key_size == sizeof(K) && h.value_size == sizeof(V) &&
+                 h.table_size != 0 && (h.table_size & (h.table_size - 1)) == 0 &&
+                 h.keys_offset == keys_offset && h.values_offset == values_offset &&
+                 values_offset + h.table_size * sizeof(V) == map_size;
+
+    if (valid && h.size != 0) {
+        const char *base = static_cast<const char *>(map);
+        valid = h.check_slot < h.table_size &&
+                base[SNAPSHOT_HEADER_SIZE + h.check_slot] == SNAPSHOT_FULL &&
+                hash_func(reinterpret_cast<const K *>(base + keys_offset)[h.check_slot]) ==
+                h.check_hash;
+    }
+    if (valid && verify_checksum) {
+        const char *payload = static_cast<const char *>(map) + SNAPSHOT_HEADER_SIZE;
+        size_t len = map_size - SNAPSHOT_HEADER_SIZE;
+        uint64_t checksum = 0;
+        for (size_t off = 0; off < len; off += SNAPSHOT_BLOCK_SIZE) {
+            checksum = wy::hash_bytes(payload + off,
+                                      std::min(len - off, (size_t)SNAPSHOT_BLOCK_SIZE), checksum);
+        }
+        valid = checksum == h.checksum;
+    }
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    const char *base = static_cast<const char *>(map);
+    table_size = h.table_size;
+    size = h.size;
+    states = reinterpret_cast<const uint8_t *>(base + SNAPSHOT_HEADER_SIZE);
+    keys = reinterpret_cast<const K *>(base + keys_offset);
+    values = reinterpret_cast<const V *>(base + values_offset);
+    return true;
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+void HashTableSnapshot<K, V, Probe, Hash>::close() {
+    if (map) {
+        munmap(map, map_size);
+    }
+    map = nullptr;
+    map_size = 0;
+    table_size = 0;
+    size = 0;
+    states = nullptr;
+    keys = nullptr;
+    values = nullptr;
+}
+
+/* Same probe walk and return value as HashTable::get */
+template <typename K, typename V, typename Probe, typename Hash>
+int HashTableSnapshot<K, V, Probe, Hash>::get(const K &key, V &value) const {
+    if (table_size == 0) {
+        return -1;
+    }
+    unsigned long initial = hash_func(key) & (table_size - 1);
+    unsigned long cur = initial;
+    for (unsigned long step = 1; step <= table_size; step++) {
+        if (states[cur] == SNAPSHOT_EMPTY) {
+            return -1;
+        }
+        if (states[cur] == SNAPSHOT_FULL && keys[cur] == key) {
+            value = values[cur];
+            return step;
+        }
+        cur = Probe::next(initial, step, table_size);
+    }
+    return -1;
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+size_t HashTableSnapshot<K, V, Probe, Hash>::get_table_size() const {
+    return table_size;
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+size_t HashTableSnapshot<K, V, Probe, Hash>::get_size() const {
+    return size;
+}
+
+template <typename K, typename V, typename Probe, typename Hash>
+double HashTableSnapshot<K, V, Probe, Hash>::get_load_factor() const {
+    return table_size ? (double)size/table_size : 0.0;
+}
+
+#endif // __HASH_SNAPSHOT_H_
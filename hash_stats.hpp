@@ -0,0 +1,183 @@
+#ifndef __HASH_STATS_H_
+#define __HASH_STATS_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Instrumentation for HashTable.
+ *
+ * Define HASH_TABLE_STATS before including hash_table.hpp to turn the
+ * counters on. They are compiled out otherwise: HASH_STATS(...) expands
+ * to nothing and a table carries no extra state. With them on, each
+ * operation costs one histogram increment, and only a resize reads the
+ * clock.
+ *
+ * HashTable::get_stats() returns a HashTableStats snapshot. The shape of
+ * the table (longest cluster, tombstone ratio) is measured by scanning
+ * it at that point and is available either way; the operation and resize
+ * counters stay zero unless HASH_TABLE_STATS is defined.
+ */
+
+#ifdef HASH_TABLE_STATS
+#define HASH_STATS(stmt) stmt
+#else
+#define HASH_STATS(stmt)
+#endif
+
+/* Probe counts of HASH_STATS_HISTOGRAM_SIZE and above share the last
+ * histogram bucket */
+#define HASH_STATS_HISTOGRAM_SIZE 32
+
+inline uint64_t hash_stats_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct HashOpStats {
+    /* For get and remove a hit means the key was found. For put it means
+     * the entry was inserted; a miss is a put of a key already present. */
+    uint64_t hits;
+    uint64_t misses;
+
+    /* histogram[i] counts hits that took i + 1 probes. miss_histogram[i]
+     * counts misses that visited i + 1 slots before giving up, in both
+     * tables while an incremental resize runs. */
+    uint64_t histogram[HASH_STATS_HISTOGRAM_SIZE];
+    uint64_t miss_histogram[HASH_STATS_HISTOGRAM_SIZE];
+
+    HashOpStats() {
+        reset();
+    }
+
+    void reset() {
+        hits = 0;
+        misses = 0;
+        for (size_t i = 0; i < HASH_STATS_HISTOGRAM_SIZE; i++) {
+            histogram[i] = 0;
+            miss_histogram[i] = 0;
+        }
+    }
+
+    void record(int probe) {
+        histogram[bucket(probe)]++;
+        hits++;
+    }
+
+    void record_miss(int probes) {
+        miss_histogram[bucket(probes)]++;
+        misses++;
+    }
+
+    double hit_rate() const {
+        return hits + misses ? (double)hits/(hits + misses) : 0.0;
+    }
+
+    double mean_probes() const {
+        return hits ? (double)total(histogram)/hits : 0.0;
+    }
+
+    double mean_miss_probes() const {
+        return misses ? (double)total(miss_histogram)/misses : 0.0;
+    }
+
+    std::string to_json() const {
+        return "{\"hits\": " + std::to_string(hits) +
+               ", \"misses\": " + std::to_string(misses) +
+               ", \"histogram\": " + json_array(histogram) +
+               ", \"miss_histogram\": " + json_array(miss_histogram) + "}";
+    }
+
+private:
+    static size_t bucket(int probe) {
+        return probe < 1 ? 0
+               : (size_t)probe < HASH_STATS_HISTOGRAM_SIZE ? probe - 1
+               : HASH_STATS_HISTOGRAM_SIZE - 1;
+    }
+
+    static uint64_t total(const uint64_t *h) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < HASH_STATS_HISTOGRAM_SIZE; i++) {
+            sum += h[i] * (i + 1);
+        }
+        return sum;
+    }
+
+    static std::string json_array(const uint64_t *h) {
+        std::string s = "[";
+        for (size_t i = 0; i < HASH_STATS_HISTOGRAM_SIZE; i++) {
+            s += (i ? ", " : "") + std::to_string(h[i]);
+        }
+        return s + "]";
+    }
+};
+
+struct HashTableStats {
+    HashOpStats get;
+    HashOpStats put;
+    HashOpStats remove;
+
+    /* Resizes started (grow, shrink or rebuild in place), total time
+     * spent rehashing, and the longest single pause a resize caused.
+     * With incremental resizing each migration step is one pause. */
+    uint64_t resizes;
+    uint64_t resize_ns;
+    uint64_t max_resize_pause_ns;
+
+    /* Measured by get_stats() */
+    size_t table_size;
+    size_t size;
+    size_t tombstones;
+    size_t longest_cluster;
+
+    HashTableStats() {
+        reset();
+    }
+
+    void reset() {
+        get.reset();
+        put.reset();
+        remove.reset();
+        resizes = 0;
+        resize_ns = 0;
+        max_resize_pause_ns = 0;
+        table_size = 0;
+        size = 0;
+        tombstones = 0;
+        longest_cluster = 0;
+    }
+
+    void record_resize_pause(uint64_t ns) {
+        resize_ns += ns;
+        if (ns > max_resize_pause_ns) {
+            max_resize_pause_ns = ns;
+        }
+    }
+
+    double load_factor() const {
+        return table_size ? (double)size/table_size : 0.0;
+    }
+
+    double tombstone_ratio() const {
+        return table_size ? (double)tombstones/table_size : 0.0;
+    }
+
+    std::string to_json() const {
+        return "{\"get\": " + get.to_json() +
+               ", \"put\": " + put.to_json() +
+               ", \"remove\": " + remove.to_json() +
+               ", \"resizes\": " + std::to_string(resizes) +
+               ", \"resize_ns\": " + std::to_string(resize_ns) +
+               ", \"max_resize_pause_ns\": " + std::to_string(max_resize_pause_ns) +
+               ", \"table_size\": " + std::to_string(table_size) +
+               ", \"size\": " + std::to_string(size) +
+               ", \"tombstones\": " + std::to_string(tombstones) +
+               ", \"load_factor\": " + std::to_string(load_factor()) +
+               ", \"tombstone_ratio\": " + std::to_string(tombstone_ratio()) +
+               ", \"longest_cluster\": " + std::to_string(longest_cluster) + "}";
+    }
+};
+
+#endif // __HASH_STATS_H_
@@ -1,202 +1,617 @@
+#ifndef __HASH_TABLE_H_
+#define __HASH_TABLE_H_
+
 #include <algorithm>
 #include <iostream>
 #include <vector>
 #include <functional>
 #include <iterator>
 #include <memory>
+#include <string>
+#include <type_traits>
 
 #define INITIAL_TABLE_SIZE 64
 
+/* Rehash thresholds, as fractions of the table size:
+ * grow when live entries exceed MAX_LOAD_FACTOR, rebuild in place when
+ * live entries plus tombstones exceed MAX_USED_FACTOR, and halve the
+ * table when live entries drop below MIN_LOAD_FACTOR. */
+#define MAX_LOAD_FACTOR 0.5
+#define MAX_USED_FACTOR 0.75
+#define MIN_LOAD_FACTOR 0.125
+
 #include "hash_slot.hpp"
 #include "hash_funcs.hpp"
+#include "hash_stats.hpp"
+
+/* Slots of the old table migrated by each operation during an
+ * incremental resize */
+#define INCREMENTAL_REHASH_STEP 16
+
+/* Bytes of a drained old table given back to the allocator by each
+ * operation after an incremental resize */
+#define INCREMENTAL_RELEASE_BYTES (256 * 1024)
+
+/* get_batch/put_batch hash and prefetch this many keys ahead of probing */
+#define BATCH_GROUP_SIZE 16
+
+/*
+ * How a HashTable moves to a new table size.
+ *
+ * ALL_AT_ONCE rehashes every entry inside the put/remove that crossed
+ * the threshold. INCREMENTAL keeps the old table next to the new one and
+ * migrates INCREMENTAL_REHASH_STEP old slots on each get/put/remove
+ * until the old table is drained, then frees the drained table
+ * INCREMENTAL_RELEASE_BYTES at a time, so no single operation pays for
+ * the whole rehash or for freeing the old table.
+ */
+enum class ResizeMode { ALL_AT_ONCE, INCREMENTAL };
+
+/*
+ * Probe sequences of the derived tables, kept as plain static functions
+ * so that HashTableSnapshot can walk a saved table the same way. `id'
+ * is recorded in snapshots; 0 is reserved for tables with their own
+ * probing, which cannot be saved.
+ */
+struct LinearProbe {
+    static constexpr uint32_t id = 1;
+
+    static unsigned long next(unsigned long pos, unsigned long step, size_t table_size) {
+        return (pos + step) & (table_size - 1);
+    }
+};
+
+struct QuadProbe {
+    static constexpr uint32_t id = 2;
+
+    static unsigned long next(unsigned long pos, unsigned long step, size_t table_size) {
+        return (pos + (step + step * step)/2) & (table_size - 1);
+    }
+};
 
-template <typename K, typename V>
+/*
+ * `Hash' is the hash function policy (see hash_funcs.hpp). The default,
+ * VirtualHash, wraps a HashFunc pointer; FastHash can be inlined.
+ *
+ * `Layout' decides how slots are stored; see SlotArray (one struct per
+ * slot, the default) and SplitSlotArray (keys, values and states in
+ * separate arrays) in hash_slot.hpp.
+ *
+ * The table size is always a power of two, so positions are reduced with
+ * a mask rather than a division.
+ */
+template <typename K, typename V, typename Hash = VirtualHash,
+          typename Layout = SlotArray<K, V> >
 class HashTable {
 public:
-    HashTable(HashFunc *hash_func);
-    ~HashTable();
+    HashTable(Hash hash_func = Hash(),
+              ResizeMode resize_mode = ResizeMode::ALL_AT_ONCE);
+    virtual ~HashTable();
     int get(const K &key, V &value);
     int put(const K &key, const V &value);
+    int put(K &&key, V &&value);
     int remove(const K &key);
+
+    /* Look up `key' without copying its value. The pointer is invalidated
+     * by the next call that may modify or rehash the table. */
+    V *find(const K &key);
+
+    /* Insert (key, V(args...)) if `key' is absent; V is constructed in
+     * its slot and nothing is built at all when the key exists. Returns
+     * the probe count, or -1 if the key was already present. */
+    template <typename... Args>
+    int try_emplace(const K &key, Args &&...args);
+    template <typename... Args>
+    int try_emplace(K &&key, Args &&...args);
+
+    /* Insert the entry std::pair<K, V>(args...) unless its key exists */
+    template <typename... Args>
+    int emplace(Args &&...args);
+
+    /* Batched get/put of n keys. probes[i] receives what get/put would
+     * return for keys[i]; values[i] is only written on a hit. */
+    void get_batch(const K *keys, size_t n, V *values, int *probes);
+    void put_batch(const K *keys, const V *values, size_t n, int *probes);
+
     size_t get_table_size();
     size_t get_size();
+    size_t get_tombstone_count();
     double get_load_factor();
+    bool is_rehashing();
+
+    /* Counters and table shape, see hash_stats.hpp. Scans the table. */
+    HashTableStats get_stats();
+    void reset_stats();
 
 protected:
     size_t table_size;
     
 private:
-    HashFunc *hash_func;
+    Hash hash_func;
+    ResizeMode resize_mode;
     size_t size;
-    HashSlot<K, V> *table;
+    size_t tombstones;
+    Layout table;
 
+    /* The table being drained by an incremental resize. Slots below
+     * rehash_idx have already been moved; old_table_size is 0 when no
+     * resize is in progress. A drained table is released in steps while
+     * releasing_old_table is set. */
+    Layout old_table;
+    size_t old_table_size;
+    size_t rehash_idx;
+    bool releasing_old_table;
+
+#ifdef HASH_TABLE_STATS
+    HashTableStats stats;
+#endif
+
+    // Snapshots are opt-in, see save_snapshot() in hash_snapshot.hpp
+    template <typename K2, typename V2, typename H2, typename L2>
+    friend bool save_snapshot(HashTable<K2, V2, H2, L2> &t, const std::string &path);
 
     // Should be overriden by the derived class
-    virtual unsigned long get_next_pos(unsigned long pos,
-                                       unsigned long step) = 0;
-    unsigned long get_pos(const K key);
-    void enlarge_table();
+    virtual unsigned long get_next_pos(unsigned long pos, unsigned long step,
+                                       size_t table_size) = 0;
+    // Id of the probe sequence for snapshots, 0 if it has none
+    virtual uint32_t get_probe_id() {
+        return 0;
+    }
+    unsigned long get_pos(const K &key, size_t t_size);
+    bool find_slot(Layout &t, size_t t_size, const K &key, unsigned long hash,
+                   unsigned long &pos, int &probe, int &walked);
+    V *find_hashed(const K &key, unsigned long hash, int &probe);
+    template <typename KK, typename... Args>
+    int emplace_hashed(KK &&key, unsigned long hash, Args &&...args);
+    void insert_new(K &&key, V &&value);
+    void start_rehash(size_t new_table_size);
+    void rehash_step(size_t slots);
+    void resize_table();
 };
 
-template <typename K, typename V>
-HashTable<K, V>::HashTable(HashFunc *hash_func): table(), hash_func(hash_func),
-                                                 size(0), table_size(INITIAL_TABLE_SIZE) {
-    table = new HashSlot<K, V>[table_size];
-}
-
-template <typename K, typename V>
-HashTable<K, V>::~HashTable() {
-    delete[] table;
-}
-
-template <typename K, typename V>
-void HashTable<K, V>::enlarge_table() {
-    // TODO
-    // std::cout << "Debug1\n";
-    if(get_load_factor() > 0.5){
-        // std::cout << "Debug1-1\n";
-        // std::cout << table_size << '\n';
-        table_size = table_size * 2;
-        HashSlot<K,V> *new_table = new HashSlot<K, V>[table_size];
-        for(int i = 0; i < table_size/2; i++){
-            if(!table[i].is_empty()){
-                unsigned long pos = get_pos(table[i].get_key());
-                unsigned long initial = pos;
-                int probe = 1;
-                while(!new_table[pos].is_empty() || new_table[pos].is_removed()){
-                    pos = get_next_pos(initial, probe);
-                    probe++;
-                }
-                new_table[pos].set_key_value(table[i].get_key(),table[i].get_value());
-            }
-            if(table[i].is_removed()){
-                unsigned long pos2 = get_pos(table[i].get_key());
-                unsigned long initial2 = pos2;
-                int probe = 1;
-                while(!new_table[pos2].is_empty() || new_table[pos2].is_removed()){
-                    pos2 = get_next_pos(initial2, probe);
-                    probe++;
-                }
-                new_table[pos2].set_removed();
-            }
+template <typename K, typename V, typename Hash, typename Layout>
+HashTable<K, V, Hash, Layout>::HashTable(Hash hash_func, ResizeMode resize_mode)
+    : table_size(INITIAL_TABLE_SIZE), hash_func(hash_func),
+      resize_mode(resize_mode), size(0), tombstones(0),
+      table(INITIAL_TABLE_SIZE), old_table(0), old_table_size(0),
+      rehash_idx(0), releasing_old_table(false) {
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+HashTable<K, V, Hash, Layout>::~HashTable() {
+}
+
+/* Put a key known to be absent into the current table, reusing the first
+ * tombstone or empty slot on its chain. */
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::insert_new(K &&key, V &&value) {
+    unsigned long pos = get_pos(key, table_size);
+    unsigned long initial = pos;
+    int probe = 1;
+    while (!table.is_empty(pos)) {
+        pos = get_next_pos(initial, probe, table_size);
+        probe++;
+    }
+    if (table.is_removed(pos)) {
+        tombstones--;
+    }
+    table.emplace(pos, std::move(key), std::move(value));
+}
+
+/* Swap in an empty table of `new_table_size' slots and start draining
+ * the current one into it. Only live entries are carried over, so every
+ * tombstone is dropped. */
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::start_rehash(size_t new_table_size) {
+    Layout new_table(new_table_size);
+    old_table.swap(table);
+    table.swap(new_table);
+    old_table_size = table_size;
+    table_size = new_table_size;
+    rehash_idx = 0;
+    tombstones = 0;
+}
+
+/* Move the live entries among the next `slots' slots of the old table.
+ * Moved slots are left as tombstones so that probe chains through them
+ * stay intact for lookups that still reach the old table. Once the
+ * old table of an incremental resize is drained, each call gives back
+ * part of its memory instead. */
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::rehash_step(size_t slots) {
+    if (old_table_size == 0) {
+        if (releasing_old_table) {
+            HASH_STATS(uint64_t start = hash_stats_now_ns());
+            releasing_old_table = !old_table.release(INCREMENTAL_RELEASE_BYTES);
+            HASH_STATS(stats.record_resize_pause(hash_stats_now_ns() - start));
+        }
+        return;
+    }
+    HASH_STATS(uint64_t start = hash_stats_now_ns());
+
+    for (; slots > 0 && rehash_idx < old_table_size; slots--, rehash_idx++) {
+        if (old_table.is_empty(rehash_idx)) {
+            continue;
+        }
+        insert_new(old_table.take_key(rehash_idx), old_table.take_value(rehash_idx));
+        old_table.set_removed(rehash_idx);
+    }
+
+    if (rehash_idx == old_table_size) {
+        old_table_size = 0;
+        if (resize_mode == ResizeMode::INCREMENTAL) {
+            releasing_old_table = true;
+        }
+        else {
+            Layout drained(0);
+            old_table.swap(drained);
         }
-        delete[] table;
-        table = new_table;
     }
+
+    // an all-at-once rehash is timed as a whole by resize_table()
+    HASH_STATS(if (resize_mode == ResizeMode::INCREMENTAL)
+                   stats.record_resize_pause(hash_stats_now_ns() - start));
 }
 
-template <typename K, typename V>
-unsigned long HashTable<K, V>::get_pos(const K key) {
-    // TODO
-    unsigned long pos = hash_func->hash(key) % table_size;
-    return pos;
+/* Called after every put/remove. Tombstones lengthen probe chains just
+ * like live entries do, so they count toward the in-place rebuild
+ * threshold even though get_size() does not see them.
+ *
+ * Nothing is started while an incremental resize is still running or its
+ * old table is still being released. The old table drains in at most
+ * old_table_size / INCREMENTAL_REHASH_STEP operations and is released in
+ * far fewer, well before any of the thresholds can be crossed again. */
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::resize_table() {
+    if (is_rehashing() || releasing_old_table) {
+        return;
+    }
+
+    size_t new_table_size;
+    if (size > table_size * MAX_LOAD_FACTOR) {
+        new_table_size = table_size * 2;
+    }
+    else if (size + tombstones > table_size * MAX_USED_FACTOR) {
+        new_table_size = table_size;
+    }
+    else if (table_size > INITIAL_TABLE_SIZE && size < table_size * MIN_LOAD_FACTOR) {
+        new_table_size = table_size / 2;
+    }
+    else {
+        return;
+    }
+
+    HASH_STATS(uint64_t start = hash_stats_now_ns());
+    start_rehash(new_table_size);
+    if (resize_mode == ResizeMode::ALL_AT_ONCE) {
+        rehash_step(old_table_size);
+    }
+    HASH_STATS(stats.resizes++);
+    HASH_STATS(stats.record_resize_pause(hash_stats_now_ns() - start));
 }
 
-template <typename K, typename V>
-int HashTable<K, V>::get(const K &key, V &value) {
-    // TODO
-    // std::cout << "Debug2\n";
-    int probe = 1;
-    unsigned long pos = get_pos(key);
-    unsigned long initial = pos;
-    // if(table[pos].is_removed()){
-    //     std::cout<< "Debug 2-1\n";
-    // }
-    while(!table[pos].is_empty() || table[pos].is_removed()){
-        if(!table[pos].is_removed() && table[pos].get_key() == key){
-            value = table[pos].get_value();
-            // std::cout << "Getting key: " << key << "value: " << value << " at position " << pos << std::endl;
-            return probe;
+template <typename K, typename V, typename Hash, typename Layout>
+unsigned long HashTable<K, V, Hash, Layout>::get_pos(const K &key, size_t t_size) {
+    return hash_func(key) & (t_size - 1);
+}
+
+/*
+ * Walk the probe chain of `key', whose hash is `hash', in table `t'
+ * exactly once.
+ *
+ * If the key is present, `pos' and `probe' point at its slot and true is
+ * returned. Otherwise `pos' and `probe' point at the slot a put() should
+ * use: the first tombstone seen on the way, or the empty slot that ended
+ * the chain. `probe' is -1 if the chain has no free slot at all.
+ * Either way `walked' is the number of slots visited.
+ */
+template <typename K, typename V, typename Hash, typename Layout>
+bool HashTable<K, V, Hash, Layout>::find_slot(Layout &t, size_t t_size, const K &key,
+                                              unsigned long hash, unsigned long &pos,
+                                              int &probe, int &walked) {
+    unsigned long initial = hash & (t_size - 1);
+    unsigned long cur = initial;
+    int free_probe = -1;
+
+    walked = t_size;
+    for (unsigned long step = 1; step <= t_size; step++) {
+        if (t.is_removed(cur)) {
+            if (free_probe == -1) {
+                pos = cur;
+                free_probe = step;
+            }
         }
-        pos = get_next_pos(initial, probe);
-        probe++;
+        else if (t.is_empty(cur)) {
+            if (free_probe == -1) {
+                pos = cur;
+                free_probe = step;
+            }
+            walked = step;
+            break;
+        }
+        else if (t.get_key(cur) == key) {
+            pos = cur;
+            probe = step;
+            walked = step;
+            return true;
+        }
+        cur = get_next_pos(initial, step, t_size);
     }
 
-    return -1;
+    probe = free_probe;
+    return false;
 }
 
-template <typename K, typename V>
-int HashTable<K, V>::put(const K &key, const V &value) {
-    // TODO
-    // std::cout << "Debug3\n";
-    int probe = 1;
-    unsigned long pos = get_pos(key);
-    unsigned long initial = pos;
-    V value2;
-    if(get(key,value2) != -1){
+/*
+ * While an incremental resize runs, a key lives in exactly one of the two
+ * tables. The current table is searched first; the probe count returned
+ * is the one of the table where the key was found. A miss is recorded
+ * with the slots visited in both tables.
+ */
+template <typename K, typename V, typename Hash, typename Layout>
+V *HashTable<K, V, Hash, Layout>::find_hashed(const K &key, unsigned long hash, int &probe) {
+    unsigned long pos;
+    int walked, old_walked = 0;
+    rehash_step(INCREMENTAL_REHASH_STEP);
+    if (find_slot(table, table_size, key, hash, pos, probe, walked)) {
+        HASH_STATS(stats.get.record(probe));
+        return &table.get_value(pos);
+    }
+    if (is_rehashing() &&
+        find_slot(old_table, old_table_size, key, hash, pos, probe, old_walked)) {
+        HASH_STATS(stats.get.record(probe));
+        return &old_table.get_value(pos);
+    }
+    HASH_STATS(stats.get.record_miss(walked + old_walked));
+    return nullptr;
+}
+
+/* Every insertion ends up here: `key' and `args' are forwarded straight
+ * into the free slot, so an rvalue key or value is moved, never copied. */
+template <typename K, typename V, typename Hash, typename Layout>
+template <typename KK, typename... Args>
+int HashTable<K, V, Hash, Layout>::emplace_hashed(KK &&key, unsigned long hash,
+                                                  Args &&...args) {
+    unsigned long pos, old_pos;
+    int probe, old_probe, walked, old_walked = 0;
+    rehash_step(INCREMENTAL_REHASH_STEP);
+    if (find_slot(table, table_size, key, hash, pos, probe, walked) || probe == -1 ||
+        (is_rehashing() &&
+         find_slot(old_table, old_table_size, key, hash, old_pos, old_probe, old_walked))) {
+        HASH_STATS(stats.put.record_miss(walked + old_walked));
         return -1;
     }
-    while(!table[pos].is_empty()){
-        // std::cout << "Debug3-1\n";
-        pos = get_next_pos(initial,probe);
-        probe++;
+    if (table.is_removed(pos)) {
+        tombstones--;
     }
-    table[pos].set_key_value(key,value);
+    table.emplace(pos, std::forward<KK>(key), std::forward<Args>(args)...);
     size++;
-    enlarge_table();
-    // std::cout << "Removing key: " << key << "value: " << value << " at position " << pos << std::endl;
+    HASH_STATS(stats.put.record(probe));
+    resize_table();
     return probe;
 }
 
-template <typename K, typename V>
-int HashTable<K, V>::remove(const K &key) {
-    // TODO
-    // std::cout << "Debug4\n";
-    int probe = 1;
-    unsigned long pos = get_pos(key);
-    unsigned long initial = pos;
-    V value;
-    if(get(key, value) != -1){
-        probe = get(key,value); 
-        pos = get_next_pos(initial, probe-1);
-        table[pos].set_removed();
-        size--;
-        return probe;
+template <typename K, typename V, typename Hash, typename Layout>
+int HashTable<K, V, Hash, Layout>::get(const K &key, V &value) {
+    int probe;
+    V *found = find_hashed(key, hash_func(key), probe);
+    if (!found) {
+        return -1;
     }
-    return -1;
+    value = *found;
+    return probe;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+V *HashTable<K, V, Hash, Layout>::find(const K &key) {
+    int probe;
+    return find_hashed(key, hash_func(key), probe);
 }
 
-template <typename K, typename V>
-size_t HashTable<K, V>::get_table_size() {
+template <typename K, typename V, typename Hash, typename Layout>
+int HashTable<K, V, Hash, Layout>::put(const K &key, const V &value) {
+    return emplace_hashed(key, hash_func(key), value);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+int HashTable<K, V, Hash, Layout>::put(K &&key, V &&value) {
+    unsigned long hash = hash_func(key);
+    return emplace_hashed(std::move(key), hash, std::move(value));
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+template <typename... Args>
+int HashTable<K, V, Hash, Layout>::try_emplace(const K &key, Args &&...args) {
+    return emplace_hashed(key, hash_func(key), std::forward<Args>(args)...);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+template <typename... Args>
+int HashTable<K, V, Hash, Layout>::try_emplace(K &&key, Args &&...args) {
+    unsigned long hash = hash_func(key);
+    return emplace_hashed(std::move(key), hash, std::forward<Args>(args)...);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+template <typename... Args>
+int HashTable<K, V, Hash, Layout>::emplace(Args &&...args) {
+    std::pair<K, V> entry(std::forward<Args>(args)...);
+    unsigned long hash = hash_func(entry.first);
+    return emplace_hashed(std::move(entry.first), hash, std::move(entry.second));
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+int HashTable<K, V, Hash, Layout>::remove(const K &key) {
+    unsigned long hash = hash_func(key);
+    unsigned long pos;
+    int probe, walked, old_walked = 0;
+    rehash_step(INCREMENTAL_REHASH_STEP);
+    if (find_slot(table, table_size, key, hash, pos, probe, walked)) {
+        table.set_removed(pos);
+        tombstones++;
+    }
+    else if (is_rehashing() &&
+             find_slot(old_table, old_table_size, key, hash, pos, probe, old_walked)) {
+        old_table.set_removed(pos);
+    }
+    else {
+        HASH_STATS(stats.remove.record_miss(walked + old_walked));
+        return -1;
+    }
+    size--;
+    HASH_STATS(stats.remove.record(probe));
+    resize_table();
+    return probe;
+}
+
+/*
+ * A lone get() stalls on the cache miss of its home slot before the next
+ * one can start. The batched versions hash a group of keys and prefetch
+ * all of their home slots first, so the misses overlap, and only then
+ * probe them one by one.
+ */
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::get_batch(const K *keys, size_t n, V *values,
+                                              int *probes) {
+    unsigned long hashes[BATCH_GROUP_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_GROUP_SIZE) {
+        size_t count = std::min(n - base, (size_t)BATCH_GROUP_SIZE);
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = hash_func(keys[base + i]);
+            table.prefetch(hashes[i] & (table_size - 1));
+        }
+        for (size_t i = 0; i < count; i++) {
+            V *found = find_hashed(keys[base + i], hashes[i], probes[base + i]);
+            if (found) {
+                values[base + i] = *found;
+            }
+            else {
+                probes[base + i] = -1;
+            }
+        }
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::put_batch(const K *keys, const V *values, size_t n,
+                                              int *probes) {
+    unsigned long hashes[BATCH_GROUP_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_GROUP_SIZE) {
+        size_t count = std::min(n - base, (size_t)BATCH_GROUP_SIZE);
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = hash_func(keys[base + i]);
+            table.prefetch(hashes[i] & (table_size - 1));
+        }
+        for (size_t i = 0; i < count; i++) {
+            probes[base + i] = emplace_hashed(keys[base + i], hashes[i], values[base + i]);
+        }
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+size_t HashTable<K, V, Hash, Layout>::get_table_size() {
     return table_size;
 }
 
-template <typename K, typename V>
-size_t HashTable<K, V>::get_size() {
+template <typename K, typename V, typename Hash, typename Layout>
+size_t HashTable<K, V, Hash, Layout>::get_size() {
     return size;
 }
 
-template <typename K, typename V>
-double HashTable<K, V>::get_load_factor() {
+template <typename K, typename V, typename Hash, typename Layout>
+size_t HashTable<K, V, Hash, Layout>::get_tombstone_count() {
+    return tombstones;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+double HashTable<K, V, Hash, Layout>::get_load_factor() {
     return (double)size/table_size;
 }
 
+template <typename K, typename V, typename Hash, typename Layout>
+bool HashTable<K, V, Hash, Layout>::is_rehashing() {
+    return old_table_size != 0;
+}
+
+/* The longest cluster is the longest run of slots that are full or hold
+ * a tombstone, wrapping around the end of the table: the longest chain
+ * a linear probe can be made to walk. During an incremental resize only
+ * the new table is measured. */
+template <typename K, typename V, typename Hash, typename Layout>
+HashTableStats HashTable<K, V, Hash, Layout>::get_stats() {
+    HashTableStats result;
+#ifdef HASH_TABLE_STATS
+    result = stats;
+#endif
+    result.table_size = table_size;
+    result.size = size;
+    result.tombstones = tombstones;
+
+    size_t longest = 0, run = 0, lead = 0;
+    bool in_lead = true;
+    for (size_t i = 0; i < table_size; i++) {
+        if (!table.is_empty(i) || table.is_removed(i)) {
+            run++;
+            continue;
+        }
+        if (in_lead) {
+            lead = run;
+            in_lead = false;
+        }
+        longest = std::max(longest, run);
+        run = 0;
+    }
+    result.longest_cluster = in_lead ? table_size : std::max(longest, run + lead);
+    return result;
+}
 
-template <typename K, typename V>
-class LinearProbeHashTable: public HashTable<K, V> {
+template <typename K, typename V, typename Hash, typename Layout>
+void HashTable<K, V, Hash, Layout>::reset_stats() {
+#ifdef HASH_TABLE_STATS
+    stats.reset();
+#endif
+}
+
+
+template <typename K, typename V, typename Hash = VirtualHash,
+          typename Layout = SlotArray<K, V> >
+class LinearProbeHashTable: public HashTable<K, V, Hash, Layout> {
 public:
-    LinearProbeHashTable(HashFunc *hash_func): HashTable<K, V>(hash_func) {
+    LinearProbeHashTable(Hash hash_func = Hash(),
+                         ResizeMode resize_mode = ResizeMode::ALL_AT_ONCE)
+        : HashTable<K, V, Hash, Layout>(hash_func, resize_mode) {
     }
     
 private:
-    virtual unsigned long get_next_pos(unsigned long pos, unsigned long step) {
-        // TODO
-        unsigned long p_pos = (pos + step) % this->table_size;
-        return p_pos;
+    virtual unsigned long get_next_pos(unsigned long pos, unsigned long step,
+                                       size_t table_size) {
+        return LinearProbe::next(pos, step, table_size);
+    }
+
+    virtual uint32_t get_probe_id() {
+        return LinearProbe::id;
     }
 };
 
-template <typename K, typename V>
-class QuadProbeHashTable: public HashTable<K, V> {
+template <typename K, typename V, typename Hash = VirtualHash,
+          typename Layout = SlotArray<K, V> >
+class QuadProbeHashTable: public HashTable<K, V, Hash, Layout> {
 public:
-    QuadProbeHashTable(HashFunc *hash_func): HashTable<K, V>(hash_func) {
+    QuadProbeHashTable(Hash hash_func = Hash(),
+                       ResizeMode resize_mode = ResizeMode::ALL_AT_ONCE)
+        : HashTable<K, V, Hash, Layout>(hash_func, resize_mode) {
     }
 private:
-    virtual unsigned long get_next_pos(unsigned long pos, unsigned long step) {
-        // TODO
-        unsigned long p_pos = (pos + (step + step * step)/2) % this->table_size;
-        return p_pos;
+    virtual unsigned long get_next_pos(unsigned long pos, unsigned long step,
+                                       size_t table_size) {
+        return QuadProbe::next(pos, step, table_size);
+    }
+
+    virtual uint32_t get_probe_id() {
+        return QuadProbe::id;
     }
 };
 
- 
\ No newline at end of file
+ 
+
+#endif // __HASH_TABLE_H_
@@ -0,0 +1,112 @@
+#ifndef __NODE_POOL_H_
+#define __NODE_POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/* Nodes in the first block; each later block is twice as large, up to
+ * NODE_POOL_MAX_BLOCK nodes */
+#define NODE_POOL_FIRST_BLOCK 64
+#define NODE_POOL_MAX_BLOCK 65536
+
+/*
+ * Slab allocator for the nodes of one tree.
+ *
+ * Nodes are carved out of large blocks, so building a tree costs one
+ * malloc per block instead of one per node, and nodes allocated together
+ * sit next to each other in memory. Destroyed nodes go to a free list and
+ * are handed out again first.
+ *
+ * release() frees every block at once without running any destructor.
+ * A tree whose nodes need destructors runs them itself before calling
+ * it (see BST::clear()).
+ */
+template <typename Node>
+class NodePool {
+public:
+    NodePool(): free_list(nullptr), next(nullptr), end(nullptr),
+                block_size(NODE_POOL_FIRST_BLOCK) {
+    }
+
+    ~NodePool() {
+        release();
+    }
+
+    template <typename... Args>
+    Node *create(Args &&...args) {
+        return new (allocate()) Node(std::forward<Args>(args)...);
+    }
+
+    void destroy(Node *node) {
+        node->~Node();
+        deallocate(node);
+    }
+
+    /* Raw storage for one node */
+    void *allocate() {
+        if (free_list) {
+            Storage *s = free_list;
+            free_list = s->next;
+            return s;
+        }
+        if (next == end) {
+            add_block(block_size);
+            if (block_size < NODE_POOL_MAX_BLOCK) {
+                block_size *= 2;
+            }
+        }
+        return next++;
+    }
+
+    /* Raw storage for n nodes in one dedicated block, laid out as a
+     * plain Node array. The nodes can later be destroyed one by one like
+     * any other node. */
+    Node *allocate_contiguous(size_t n) {
+        static_assert(sizeof(Storage) == sizeof(Node),
+                      "node storage must be laid out as a Node array");
+        blocks.push_back(new Storage[n]);
+        return reinterpret_cast<Node *>(blocks.back());
+    }
+
+    void deallocate(void *p) {
+        Storage *s = static_cast<Storage *>(p);
+        s->next = free_list;
+        free_list = s;
+    }
+
+    void release() {
+        for (Storage *block : blocks) {
+            delete[] block;
+        }
+        blocks.clear();
+        free_list = nullptr;
+        next = end = nullptr;
+        block_size = NODE_POOL_FIRST_BLOCK;
+    }
+
+private:
+    union Storage {
+        Storage *next;
+        alignas(Node) unsigned char node[sizeof(Node)];
+    };
+
+    std::vector<Storage *> blocks;
+    Storage *free_list;
+    Storage *next;
+    Storage *end;
+    size_t block_size;
+
+    void add_block(size_t n) {
+        blocks.push_back(new Storage[n]);
+        next = blocks.back();
+        end = next + n;
+    }
+
+    // disallow copy and assignment
+    NodePool(const NodePool &);
+    NodePool & operator=(const NodePool &);
+};
+
+#endif // __NODE_POOL_H_
@@ -15,25 +15,71 @@
 #include <iostream>
 #include <optional>
 #include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+
+#include "node_pool.hpp"
 
 static size_t null_count = 0;
 
-template <typename T>
+template <typename T, typename V = void>
 struct RBNode;
 
 using color_t = bool;
 constexpr static color_t RED = false;
 constexpr static color_t BLK = true;
 
+/* Bound on the height of any red-black tree that fits in memory
+ * (at most 2 log2(n + 1)); sizes the stacks of the in-order walks */
+constexpr static size_t RB_MAX_HEIGHT = 128;
+
 /* This is an abstraction for search-path. For debugging purpose */
 struct Path;
 
-template<typename T>
+/* Payload of a map node. A set node (V = void) has none, and the empty
+ * base takes no space. */
+template <typename V>
+struct RBValue {
+    V value;
+
+    template <typename... Args>
+    RBValue(Args&&... args) : value(std::forward<Args>(args)...) {}
+};
+
+template <>
+struct RBValue<void> {};
+
+/*
+ * Classic (not left-leaning) red-black tree, updated in a single
+ * top-down pass in the manner of Julienne Walker: insert splits 4-nodes
+ * and fixes red-red links on the way down, delete pushes a red node
+ * down in front of it, so neither has to walk back up. Both are loops
+ * that keep only the current node and its two or three ancestors, i.e.
+ * O(1) extra space and no recursion. The subtree sizes are updated in
+ * the same pass (see select() below).
+ *
+ * Nodes come from a NodePool owned by the tree, so they sit together in
+ * large blocks rather than one malloc each.
+ *
+ * RBTree<K> is a set of keys. RBTree<K, V> is a map: every node also
+ * holds a V, reached with find(), emplace() and insert_or_assign() in a
+ * single descent each. The value pointers they return stay valid until
+ * the next remove, which may move another key's value into the node it
+ * unlinks.
+ */
+template<typename T, typename V = void>
 struct RBTree {
-    std::unique_ptr<RBNode<T>> root = nullptr;
+    RBNode<T, V>* root = nullptr;
 
-    ~RBTree() = default;
+    RBTree() {}
+    ~RBTree() { clear(); }
 
+    /* Remove every key and give all node memory back at once */
+    void clear();
+
+    /* Returns false if t is already there. In a map the new value is
+     * default-constructed. */
     bool insert(const T&);
     void remove_max();
     void remove_min();
@@ -42,43 +88,173 @@ struct RBTree {
     const std::optional<T> leftmost_key();
     const std::optional<T> rightmost_key();
 
-    void traverse_inorder(std::function<void(RBNode<T>*)>);
+    /* f(RBNode<T, V>*) for every node in key order */
+    template <typename F>
+    void traverse_inorder(F f);
+
+    /* f(RBNode<T, V>*) for the nodes with lo <= key <= hi in key order,
+     * visiting O(log n + k) nodes for k matches */
+    template <typename F>
+    void for_each_in_range(const T& lo, const T& hi, F f);
 
     bool contains(const T& t);
 
-    std::unordered_map<Path, const RBNode<T>&> collect_all_leaves() const;
+    size_t size() const;
+
+    /*
+     * Order statistics from the subtree sizes, O(log n) each. Insert and
+     * remove adjust each size as they step onto its node, betting that a
+     * key will be added or unlinked below it, and rotations recompute
+     * the nodes they move. Only a duplicate insert or the remove of a
+     * missing key loses the bet and walks its path once more to undo it.
+     */
+    /* k-th smallest key (0-based), or nullptr if k >= size() */
+    const T* select(size_t k);
+    /* Number of keys smaller than t */
+    size_t rank(const T& t);
+
+    /*
+     * Bidirectional in-order iterator over the nodes. There are no
+     * parent links, so it carries the path from the root down to its
+     * node, on the heap and only as long as the tree is deep; a step is
+     * amortized O(1). Decrementing end() gives the largest key. Any
+     * insert or remove invalidates it.
+     */
+    class Iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef RBNode<T, V> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef RBNode<T, V>* pointer;
+        typedef RBNode<T, V>& reference;
+
+        Iterator() {}
+
+        RBNode<T, V>& operator*() const { return *path.back(); }
+        RBNode<T, V>* operator->() const { return path.back(); }
+
+        Iterator& operator++();
+        Iterator& operator--();
+        Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+        Iterator operator--(int) { Iterator it = *this; --*this; return it; }
+
+        bool operator==(const Iterator& other) const {
+            return path.empty() ? other.path.empty()
+                : !other.path.empty() && path.back() == other.path.back();
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        friend struct RBTree;
+
+        const RBTree* tree = nullptr;
+        /* The current node and its ancestors, root first; empty at end() */
+        std::vector<RBNode<T, V>*> path;
+
+        /* An iterator into t with room reserved for its deepest path */
+        explicit Iterator(const RBTree* t);
+
+        /* Push n and its chain of left (right) children */
+        void push_leftmost(RBNode<T, V>* n);
+        void push_rightmost(RBNode<T, V>* n);
+    };
+
+    Iterator begin();
+    Iterator end();
+    /* First node with key >= t, or end() */
+    Iterator lower_bound(const T& t);
+    /* First node with key > t, or end() */
+    Iterator upper_bound(const T& t);
+
+    /* Map mode only */
+
+    /* The value stored under t, or nullptr */
+    V* find(const T& t);
+    /* Construct the value from args unless t is already there; returns
+     * the value under t and whether it was inserted */
+    template <typename... Args>
+    std::pair<V*, bool> emplace(const T& t, Args&&... args);
+    /* Insert t with value, or assign value to the one already there;
+     * returns true if t was inserted */
+    template <typename U>
+    bool insert_or_assign(const T& t, U&& value);
+
+    std::unordered_map<Path, const RBNode<T, V>&> collect_all_leaves() const;
 
     std::string format_graphviz();
+
+private:
+    NodePool<RBNode<T, V>> pool;
+
+    /* The one top-down insert pass behind insert, emplace and
+     * insert_or_assign. Returns the node holding t, built from t and
+     * args if it was not there, and whether it was. */
+    template <typename... Args>
+    std::pair<RBNode<T, V>*, bool> insert_node(const T& t, Args&&... args);
+
+    /* Make whichever link of parent held old (the root if parent is
+     * nullptr) point to n instead */
+    void replace_child(RBNode<T, V>* parent, RBNode<T, V>* old, RBNode<T, V>* n);
+
+    /* Add delta to the size of every node on the search path of t
+     * (going left on equal keys), down to and including last */
+    void adjust_sizes(const T& t, const RBNode<T, V>* last, int delta);
+
+    // disallow copy and assignment
+    RBTree(const RBTree&);
+    RBTree& operator=(const RBTree&);
 };
 
-template<typename T>
-struct RBNode {
+template<typename T, typename V>
+struct RBNode : RBValue<V> {
     T key;
-    color_t color = RED;
-    std::unique_ptr<RBNode> left = nullptr;
-    std::unique_ptr<RBNode> right = nullptr;
+    RBNode* right = nullptr;
+    /* Number of nodes in this subtree, this one included */
+    size_t size = 1;
 
-    RBNode(const T& t);
+    template <typename... Args>
+    RBNode(const T& t, Args&&... args);
     ~RBNode() = default;
 
+    /* The left pointer carries this node's color in its low bit, which
+     * is always clear in a node address, so a node is just its key and
+     * three words (32 bytes for an 8-byte key). */
+    RBNode* left() const {
+        return reinterpret_cast<RBNode*>(left_color & ~COLOR_BIT);
+    }
+    void set_left(RBNode* n) {
+        left_color = reinterpret_cast<uintptr_t>(n) | (left_color & COLOR_BIT);
+    }
+    color_t color() const { return left_color & COLOR_BIT; }
+    void set_color(color_t c) { left_color = (left_color & ~COLOR_BIT) | c; }
+
     bool is_leaf();
 
-    void flip_color();
-    static RBNode* rotate_right(std::unique_ptr<RBNode>&);
-    static RBNode* rotate_left(std::unique_ptr<RBNode>&);
-    static bool is_red(const std::unique_ptr<RBNode>&);
+    static size_t size_of(const RBNode* n) { return n ? n->size : 0; }
+    void update_size() { size = size_of(left()) + size_of(right) + 1; }
 
-    static RBNode* move_red_right(std::unique_ptr<RBNode>&);
-    static RBNode* move_red_left(std::unique_ptr<RBNode>&);
+    /* dir: false is left, true is right */
+    RBNode* child(bool dir) const { return dir ? right : left(); }
+    void set_child(bool dir, RBNode* n) {
+        if (dir)
+            right = n;
+        else
+            set_left(n);
+    }
 
-    static RBNode* remove_max(std::unique_ptr<RBNode>&);
-    static RBNode* remove_min(std::unique_ptr<RBNode>&);
-    static RBNode* remove(std::unique_ptr<RBNode>&, const T&);
+    /* rotate_single moves the child on side !dir up and n down to side
+     * dir, and returns the new top, which turns black while n turns red;
+     * both sizes are recomputed. rotate_double first rotates that child
+     * the other way. The caller stores the result in the link that held
+     * n. */
+    static RBNode* rotate_single(RBNode* n, bool dir);
+    static RBNode* rotate_double(RBNode* n, bool dir);
+    static bool is_red(const RBNode*);
 
-    static RBNode* insert(std::unique_ptr<RBNode>&, const T&);
-    std::pair<RBNode<T>*, Path> search(const T&, Path);
+    std::pair<RBNode<T, V>*, Path> search(const T&, Path);
 
-    void traverse_inorder(std::function<void(RBNode*)>);
+    template <typename F>
+    void traverse_inorder(F f);
     size_t get_max_depth();
 
     std::unordered_map<size_t, const RBNode&> get_nodes_at_level(size_t);
@@ -87,10 +263,8 @@ struct RBNode {
                              Path);
     std::string format_level(size_t);
 
-    std::unordered_map<Path, const RBNode<T>&> collect_all_leaves(void);
-    void _collect_all_leaves(std::unordered_map<Path, const RBNode<T>&>&, Path);
-
-    static RBNode* fix_up(std::unique_ptr<RBNode>&);
+    std::unordered_map<Path, const RBNode<T, V>&> collect_all_leaves(void);
+    void _collect_all_leaves(std::unordered_map<Path, const RBNode<T, V>&>&, Path);
 
     std::string format_graphviz();
 
@@ -98,67 +272,270 @@ struct RBNode {
 
     const T& leftmost_key();
     const T& rightmost_key();
+
+private:
+    static constexpr uintptr_t COLOR_BIT = 1;
+    static_assert(BLK == COLOR_BIT, "BLK must be the color bit set");
+
+    uintptr_t left_color = RED;
 };
 
-template<typename T>
-bool RBTree<T>::insert(const T& t) {
-    if (!root) {
-        root = std::make_unique<RBNode<T>>(t);
-        root->color = BLK;
-        return true;
+template<typename T, typename V>
+void RBTree<T, V>::replace_child(RBNode<T, V>* parent, RBNode<T, V>* old, RBNode<T, V>* n) {
+    if (!parent)
+        root = n;
+    else if (parent->right == old)
+        parent->right = n;
+    else
+        parent->set_left(n);
+}
+
+template<typename T, typename V>
+void RBTree<T, V>::adjust_sizes(const T& t, const RBNode<T, V>* last, int delta) {
+    for (RBNode<T, V>* n = root; ; n = n->child(n->key < t)) {
+        n->size += delta;
+        if (n == last)
+            return;
     }
+}
 
-    root.reset(RBNode<T>::insert(root, t));
+template<typename T, typename V>
+void RBTree<T, V>::clear() {
+    /* Keys only need their destructors run for non-trivial T; the pool
+     * then frees all nodes at once */
+    if (!std::is_trivially_destructible<T>::value) {
+        RBNode<T, V>* stack[RB_MAX_HEIGHT];
+        size_t depth = 0;
+        RBNode<T, V>* n = root;
+
+        while (n || depth) {
+            while (n) {
+                stack[depth++] = n;
+                n = n->left();
+            }
+            n = stack[--depth];
+            RBNode<T, V>* right = n->right;
+            n->~RBNode();
+            n = right;
+        }
+    }
+    root = nullptr;
+    pool.release();
+}
+
+template<typename T, typename V>
+template <typename... Args>
+std::pair<RBNode<T, V>*, bool> RBTree<T, V>::insert_node(const T& t, Args&&... args) {
+    /* q and its parent, grandparent and great-grandparent (gp, nullptr
+     * when g is the root). Right after a rotation the ancestors above
+     * the new subtree top are not known for a step or two, but a
+     * red-red link cannot show up again that soon.
+     *
+     * Every node from the root down to q already counts the key in its
+     * size, as if it were certain to be added below. */
+    RBNode<T, V>* gp = nullptr;
+    RBNode<T, V>* g = nullptr;
+    RBNode<T, V>* p = nullptr;
+    RBNode<T, V>* q = root;
+    bool dir = false, last = false;
+    bool inserted = false;
+
+    for (;;) {
+        if (!q) {
+            q = pool.create(t, std::forward<Args>(args)...);
+            if (p)
+                p->set_child(dir, q);
+            else
+                root = q;
+            inserted = true;
+        } else {
+            q->size++;
+            if (RBNode<T, V>::is_red(q->left()) && RBNode<T, V>::is_red(q->right)) {
+                /* Split a 4-node on the way down */
+                q->set_color(RED);
+                q->left()->set_color(BLK);
+                q->right->set_color(BLK);
+            }
+        }
+
+        /* Fix a red child of a red parent at the grandparent */
+        if (RBNode<T, V>::is_red(q) && RBNode<T, V>::is_red(p)) {
+            assert(g);
+            if (dir == last) {
+                replace_child(gp, g, RBNode<T, V>::rotate_single(g, !last));
+                g = gp;
+            } else {
+                /* q is the new top, rebuilt from children that do not
+                 * count the key yet */
+                replace_child(gp, g, RBNode<T, V>::rotate_double(g, !last));
+                if (!inserted)
+                    q->size++;
+                p = gp;
+                g = nullptr;
+            }
+        }
+
+        if (q->key == t)
+            break;
+
+        last = dir;
+        dir = q->key < t;
+        gp = g;
+        g = p;
+        p = q;
+        q = q->child(dir);
+    }
 
     /* Change root to black. Won't affect the balance */
-    if (root->color == RED)
-        root->color = BLK;
+    root->set_color(BLK);
+
+    if (!inserted)
+        adjust_sizes(t, q, -1);
 
-    return true;
+    return { q, inserted };
 }
 
-template<typename T>
-void RBTree<T>::remove_max() {
-    root.reset(RBNode<T>::remove_max(root));
+template<typename T, typename V>
+bool RBTree<T, V>::insert(const T& t) {
+    return insert_node(t).second;
+}
 
-    if (root)
-        root->color = BLK;
+template<typename T, typename V>
+V* RBTree<T, V>::find(const T& t) {
+    RBNode<T, V>* n = root;
+    while (n) {
+        if (t == n->key)
+            return &n->value;
+        n = t < n->key ? n->left() : n->right;
+    }
+    return nullptr;
 }
 
-template<typename T>
-void RBTree<T>::remove_min() {
-    root.reset(RBNode<T>::remove_min(root));
+template<typename T, typename V>
+template <typename... Args>
+std::pair<V*, bool> RBTree<T, V>::emplace(const T& t, Args&&... args) {
+    auto r = insert_node(t, std::forward<Args>(args)...);
+    return { &r.first->value, r.second };
+}
 
-    if (root)
-        root->color = BLK;
+template<typename T, typename V>
+template <typename U>
+bool RBTree<T, V>::insert_or_assign(const T& t, U&& value) {
+    /* value is only consumed if the node gets built from it */
+    auto r = insert_node(t, std::forward<U>(value));
+    if (!r.second)
+        r.first->value = std::forward<U>(value);
+    return r.second;
 }
 
-template<typename T>
-void RBTree<T>::remove(const T& t) {
-    root.reset(RBNode<T>::remove(root, t));
+template<typename T, typename V>
+void RBTree<T, V>::remove_max() {
+    if (auto max = rightmost_key())
+        remove(*max);
+}
+
+template<typename T, typename V>
+void RBTree<T, V>::remove_min() {
+    if (auto min = leftmost_key())
+        remove(*min);
+}
+
+template<typename T, typename V>
+void RBTree<T, V>::remove(const T& t) {
+    /* Walk down to the in-order predecessor of t (or to t itself if it
+     * has no left child), keeping the current node red or with a red
+     * child so that the node finally unlinked is never a lone black
+     * one. f is the node holding t, if it was met on the way. p is
+     * nullptr while q is the root, and g while p is.
+     *
+     * Every node from the root down to q already has one less in its
+     * size, as if t were certain to be found. */
+    RBNode<T, V>* g = nullptr;
+    RBNode<T, V>* p = nullptr;
+    RBNode<T, V>* q = nullptr;
+    RBNode<T, V>* next = root;
+    RBNode<T, V>* f = nullptr;
+    bool dir = false, last;
+
+    while (next) {
+        last = dir;
+        g = p;
+        p = q;
+        q = next;
+        q->size--;
+        dir = q->key < t;
+        if (q->key == t)
+            f = q;
+
+        /* Push a red node down */
+        if (!RBNode<T, V>::is_red(q) && !RBNode<T, V>::is_red(q->child(dir))) {
+            if (RBNode<T, V>::is_red(q->child(!dir))) {
+                /* q and the new top were rebuilt from children below q */
+                RBNode<T, V>* top = RBNode<T, V>::rotate_single(q, dir);
+                replace_child(p, q, top);
+                q->size--;
+                top->size--;
+                p = top;
+            } else if (p) {
+                RBNode<T, V>* s = p->child(!last);
+                if (s) {
+                    if (!RBNode<T, V>::is_red(s->child(!last)) &&
+                        !RBNode<T, V>::is_red(s->child(last))) {
+                        /* Merge p, q and s into a 4-node */
+                        p->set_color(BLK);
+                        s->set_color(RED);
+                        q->set_color(RED);
+                    } else {
+                        /* Borrow from the sibling */
+                        RBNode<T, V>* top = RBNode<T, V>::is_red(s->child(last)) ?
+                            RBNode<T, V>::rotate_double(p, last) :
+                            RBNode<T, V>::rotate_single(p, last);
+                        replace_child(g, p, top);
+                        q->set_color(RED);
+                        top->set_color(RED);
+                        top->left()->set_color(BLK);
+                        top->right->set_color(BLK);
+                    }
+                }
+            }
+        }
+        next = q->child(dir);
+    }
+
+    if (f) {
+        if (f != q) {
+            f->key = std::move(q->key);
+            if constexpr (!std::is_void<V>::value)
+                f->value = std::move(q->value);
+        }
+        replace_child(p, q, q->child(!q->left()));
+        pool.destroy(q);
+    } else if (q) {
+        adjust_sizes(t, q, 1);
+    }
 
     if (root)
-        root->color = BLK;
+        root->set_color(BLK);
 }
 
-template <typename T>
-const std::optional<T> RBTree<T>::leftmost_key() {
+template <typename T, typename V>
+const std::optional<T> RBTree<T, V>::leftmost_key() {
     if (!root)
         return std::nullopt;
 
     return root->leftmost_key();
 }
 
-template <typename T>
-const std::optional<T> RBTree<T>::rightmost_key() {
+template <typename T, typename V>
+const std::optional<T> RBTree<T, V>::rightmost_key() {
     if (!root)
         return std::nullopt;
 
     return root->rightmost_key();
 }
 
-template <typename T>
-bool RBTree<T>::contains(const T& t) {
+template <typename T, typename V>
+bool RBTree<T, V>::contains(const T& t) {
     if (!root)
         return false;
 
@@ -202,297 +579,310 @@ namespace std {
     };
 }
 
-template<typename T>
-bool RBNode<T>::is_leaf() {
-    return !left && !right;
+template<typename T, typename V>
+bool RBNode<T, V>::is_leaf() {
+    return !left() && !right;
 }
 
-template<typename T>
-bool RBNode<T>::is_red(const std::unique_ptr<RBNode<T>>& n) {
-    return n && n->color == RED;
+template<typename T, typename V>
+bool RBNode<T, V>::is_red(const RBNode<T, V>* n) {
+    return n && n->color() == RED;
 }
 
-template<typename T>
-void RBNode<T>::flip_color() {
-    color = !this->color;
-
-    if (left)
-        left->color = !left->color;
-
-    if (right)
-        right->color = !right->color;
+template<typename T, typename V>
+RBNode<T, V>* RBNode<T, V>::rotate_single(RBNode<T, V>* n, bool dir) {
+    RBNode<T, V>* swap = n->child(!dir);
+    n->set_child(!dir, swap->child(dir));
+    swap->set_child(dir, n);
+    swap->set_color(BLK);
+    n->set_color(RED);
+    n->update_size();
+    swap->update_size();
+    return swap;
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::rotate_right(std::unique_ptr<RBNode<T>>& n) {
-    if(!n->left){
-        return n.get();
-    }
-    // std::cout << "r_right\n";
-    auto swap = std::move(n->left);
-    n->left = std::move(swap->right);
-    swap->right = std::move(n);
-    swap->color = swap->right->color;
-    swap->right->color = RED;
-    return swap.release();
-}
-
-template<typename T>
-RBNode<T>* RBNode<T>::rotate_left(std::unique_ptr<RBNode<T>>& n) {
-    // std::cout << "r_left\n";
-    if(!n->right){
-        return n.get();
-    }
-    auto swap = std::move(n->right);
-    n->right = std::move(swap->left);
-    swap->left = std::move(n);
-    swap->color = swap->left->color;
-    swap->left->color = RED;
-    return swap.release();
+template<typename T, typename V>
+RBNode<T, V>* RBNode<T, V>::rotate_double(RBNode<T, V>* n, bool dir) {
+    n->set_child(!dir, rotate_single(n->child(!dir), !dir));
+    return rotate_single(n, dir);
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::insert(std::unique_ptr<RBNode<T>>& n, const T& t) {
-    // TODO
-    // std::cout << "Debug1\n";
-    if (n == nullptr) {
-        // std::cout << "Debug2\n";
-        return std::make_unique<RBNode<T>>(t).release();
-    }
-
-    if(n->key == t){
-        return n.release();
-    }
-    
-    else if(n -> key < t){
-        // std::cout<<"Debug3\n";
-        n->right.reset(insert(n->right,t));
-    }
-
-    else{
-        // std::cout<<"Debug4\n";
-        n->left.reset(insert(n->left,t));
-    }
-
-    //flip은 내려오면서 진행, flip과 삽입이 진행된 이후에 red-red인게 존재한다면 rotate
-    if(is_red(n->right) && !is_red(n->left)){
-        // std::cout<<"Debug5\n";
-        n.reset(rotate_left(n)); 
-    }
-
-    if(is_red(n->left) && is_red(n->left->left)){
-        // std::cout<<"Debug6\n";
-        n.reset(rotate_right(n));;
-    }
-
-    if(is_red(n->left) && is_red(n->right)){
-        // std::cout<<"Debug7\n";
-        n->flip_color();
-    }
-
-    // std::cout<< n ->key << '\n';
-    return n.release();
-}
-
-template<typename T>
-std::pair<RBNode<T>*, Path> RBNode<T>::search(const T& t, Path sp) {
+template<typename T, typename V>
+std::pair<RBNode<T, V>*, Path> RBNode<T, V>::search(const T& t, Path sp) {
     if (t > key) {
         return right ?
-            right->search(t, Path::down_right(sp, color)) :
-            std::pair<RBNode<T>*, Path>{ nullptr, {} };
+            right->search(t, Path::down_right(sp, color())) :
+            std::pair<RBNode<T, V>*, Path>{ nullptr, {} };
     } else if (t < key) {
-        return left ?
-            left->search(t, Path::down_left(sp, color)) :
-            std::pair<RBNode<T>*, Path>{ nullptr, {} };
+        return left() ?
+            left()->search(t, Path::down_left(sp, color())) :
+            std::pair<RBNode<T, V>*, Path>{ nullptr, {} };
     } else {
         return { this, sp };
     }
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::fix_up(std::unique_ptr<RBNode<T>>& n) {
-    // TODO
-    if(is_red(n->right) && !is_red(n->left)){
-        n.reset(rotate_left(n));
-    }
-    if(is_red(n->left) && is_red(n->left->left)){
-        n.reset(rotate_right(n));
-    }
-    if(is_red(n->right) && is_red(n->left)){
-        n->flip_color();
-    }
-    return n.release();
+template<typename T, typename V>
+const T& RBNode<T, V>::leftmost_key() {
+    RBNode<T, V>* n = this;
+    while (n->left())
+        n = n->left();
+
+    return n->key;
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::move_red_right(std::unique_ptr<RBNode<T>>& n) {
-    // TODO
-    n->flip_color();
-    if(is_red(n->left->left)){
-        n.reset(rotate_right(n));
-        n->flip_color();
-    }
+template<typename T, typename V>
+const T& RBNode<T, V>::rightmost_key() {
+    RBNode<T, V>* n = this;
+    while (n->right)
+        n = n->right;
 
-    return n.release();
+    return n->key;
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::remove_max(std::unique_ptr<RBNode<T>>& n) {
-    // TODO
-    if(is_red(n->left)){
-        n.reset(rotate_right(n));
-    }
-    if(n->right == nullptr){
-        return nullptr;
-    }
-    if(!is_red(n->right) && !is_red(n->right->left)){
-        n.reset(move_red_right(n));
+template<typename T, typename V>
+bool RBNode<T, V>::contains(const T& t) {
+    const RBNode<T, V>* n = this;
+    while (n) {
+        if (t == n->key)
+            return true;
+        n = t < n->key ? n->left() : n->right;
     }
-    n->right.reset(remove_max(n->right));
-    return fix_up(n);
+    return false;
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::move_red_left(std::unique_ptr<RBNode<T>>& n) {
-    // TODO
-    n->flip_color();
-    if(is_red(n->right->left)){
-        n->right.reset(rotate_right(n->right));
-        n.reset(rotate_left(n));
-        n->flip_color();    
-    }
-    return n.release();
+template<typename T, typename V>
+template <typename F>
+void RBTree<T, V>::traverse_inorder(F f) {
+    if (root)
+        root->traverse_inorder(f);
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::remove_min(std::unique_ptr<RBNode<T>>& n) {
-    // TODO
-    if(n->left == nullptr){
-        return nullptr;
-    }
-
-    if(!is_red(n->left) && !is_red(n->left->left)){
-        n.reset(move_red_left(n));
+template<typename T, typename V>
+template <typename F>
+void RBTree<T, V>::for_each_in_range(const T& lo, const T& hi, F f) {
+    RBNode<T, V>* stack[RB_MAX_HEIGHT];
+    size_t depth = 0;
+    RBNode<T, V>* n = root;
+
+    for (;;) {
+        /* Keep only the nodes >= lo on the way down */
+        while (n) {
+            if (n->key < lo) {
+                n = n->right;
+            } else {
+                stack[depth++] = n;
+                n = n->left();
+            }
+        }
+        if (!depth)
+            return;
+        n = stack[--depth];
+        if (hi < n->key)
+            return;
+        f(n);
+        n = n->right;
     }
-    
-    n->left.reset(remove_min(n->left));
+}
 
-    return fix_up(n);
+template<typename T, typename V>
+size_t RBTree<T, V>::size() const {
+    return RBNode<T, V>::size_of(root);
 }
 
-template<typename T>
-RBNode<T>* RBNode<T>::remove(std::unique_ptr<RBNode<T>>& n, const T& t) {
-    // TODO
-    if(t < n->key){
-        if(!is_red(n->left) && !is_red(n->left->left)){
-            n.reset(move_red_left(n));
+template<typename T, typename V>
+const T* RBTree<T, V>::select(size_t k) {
+    RBNode<T, V>* n = root;
+    while (n) {
+        size_t left = RBNode<T, V>::size_of(n->left());
+        if (k < left) {
+            n = n->left();
+        } else if (k == left) {
+            return &n->key;
+        } else {
+            k -= left + 1;
+            n = n->right;
         }
-        n->left.reset(remove(n->left, t));
     }
-    else{
-        if(is_red(n->left)){
-            n.reset(rotate_right(n));
-        }
-        if(n->key == t && n->right == nullptr){
-            return nullptr;
-        }
-        if(!is_red(n->right) && !is_red(n->right->left)){
-            n.reset(move_red_right(n));
-        }
-        if(n->key == t){
-            n->key = n->right->leftmost_key();
-            n->right.reset(remove_min(n->right));
-        }
-        else{
-            n->right.reset(remove(n->right, t));
+    return nullptr;
+}
+
+template<typename T, typename V>
+size_t RBTree<T, V>::rank(const T& t) {
+    size_t r = 0;
+    RBNode<T, V>* n = root;
+    while (n) {
+        if (n->key < t) {
+            r += RBNode<T, V>::size_of(n->left()) + 1;
+            n = n->right;
+        } else {
+            n = n->left();
         }
     }
-    return fix_up(n);
+    return r;
 }
 
-template<typename T>
-const T& RBNode<T>::leftmost_key() {
-    if (!left)
-        return key;
+template<typename T, typename V>
+RBTree<T, V>::Iterator::Iterator(const RBTree* t) : tree(t) {
+    /* 2 log2(n + 1) bounds the height */
+    size_t height = 0;
+    for (size_t n = t->size() + 1; n; n >>= 1)
+        height++;
+    path.reserve(2 * height);
+}
 
-    return left->leftmost_key();
+template<typename T, typename V>
+void RBTree<T, V>::Iterator::push_leftmost(RBNode<T, V>* n) {
+    for (; n; n = n->left())
+        path.push_back(n);
 }
 
-template<typename T>
-const T& RBNode<T>::rightmost_key() {
-    if (!right)
-        return key;
+template<typename T, typename V>
+void RBTree<T, V>::Iterator::push_rightmost(RBNode<T, V>* n) {
+    for (; n; n = n->right)
+        path.push_back(n);
+}
 
-    return right->rightmost_key();
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator& RBTree<T, V>::Iterator::operator++() {
+    RBNode<T, V>* n = path.back();
+    if (n->right) {
+        push_leftmost(n->right);
+    } else {
+        /* Climb past every ancestor we are in the right subtree of */
+        do {
+            n = path.back();
+            path.pop_back();
+        } while (!path.empty() && path.back()->right == n);
+    }
+    return *this;
 }
 
-template<typename T>
-bool RBNode<T>::contains(const T& t) {
-    if (t == key)
-        return true;
-    if (t < key)
-        return left && left->contains(t);
-    else /* t > key */
-        return right && right->contains(t);
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator& RBTree<T, V>::Iterator::operator--() {
+    if (path.empty()) {
+        push_rightmost(tree->root);
+        return *this;
+    }
+    RBNode<T, V>* n = path.back();
+    if (n->left()) {
+        push_rightmost(n->left());
+    } else {
+        do {
+            n = path.back();
+            path.pop_back();
+        } while (!path.empty() && path.back()->left() == n);
+    }
+    return *this;
 }
 
-template<typename T>
-void RBTree<T>::traverse_inorder(std::function<void(RBNode<T>*)> f) {
-    if (root)
-        root->traverse_inorder(f);
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator RBTree<T, V>::begin() {
+    Iterator it(this);
+    it.push_leftmost(root);
+    return it;
 }
 
-template<typename T>
-void RBNode<T>::traverse_inorder(std::function<void(RBNode*)> f) {
-    if (left)
-        left->traverse_inorder(f);
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator RBTree<T, V>::end() {
+    Iterator it;
+    it.tree = this;
+    return it;
+}
+
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator RBTree<T, V>::lower_bound(const T& t) {
+    /* The path down to the last node >= t is a prefix of the search path */
+    Iterator it(this);
+    size_t found = 0;
+    for (RBNode<T, V>* n = root; n; ) {
+        it.path.push_back(n);
+        if (n->key < t) {
+            n = n->right;
+        } else {
+            found = it.path.size();
+            n = n->left();
+        }
+    }
+    it.path.resize(found);
+    return it;
+}
 
-    f(this);
+template<typename T, typename V>
+typename RBTree<T, V>::Iterator RBTree<T, V>::upper_bound(const T& t) {
+    Iterator it(this);
+    size_t found = 0;
+    for (RBNode<T, V>* n = root; n; ) {
+        it.path.push_back(n);
+        if (!(t < n->key)) {
+            n = n->right;
+        } else {
+            found = it.path.size();
+            n = n->left();
+        }
+    }
+    it.path.resize(found);
+    return it;
+}
 
-    if (right)
-        right->traverse_inorder(f);
+template<typename T, typename V>
+template <typename F>
+void RBNode<T, V>::traverse_inorder(F f) {
+    RBNode<T, V>* stack[RB_MAX_HEIGHT];
+    size_t depth = 0;
+    RBNode<T, V>* n = this;
+
+    while (n || depth) {
+        while (n) {
+            stack[depth++] = n;
+            n = n->left();
+        }
+        n = stack[--depth];
+        f(n);
+        n = n->right;
+    }
 }
 
-template<typename T>
-size_t RBNode<T>::get_max_depth() {
+template<typename T, typename V>
+size_t RBNode<T, V>::get_max_depth() {
     if (is_leaf())
         return 1;
 
-    if (left && right)
-        return 1 + std::max(left->get_max_depth(), right->get_max_depth());
-    else if (left && !right)
-        return 1 + left->get_max_depth();
+    if (left() && right)
+        return 1 + std::max(left()->get_max_depth(), right->get_max_depth());
+    else if (left() && !right)
+        return 1 + left()->get_max_depth();
     else
         return 1 + right->get_max_depth();
 }
 
-template<typename T>
-std::unordered_map<size_t, const RBNode<T>&>
-RBNode<T>::get_nodes_at_level(size_t lvl) {
-    std::unordered_map<size_t, const RBNode<T>&> ns;
+template<typename T, typename V>
+std::unordered_map<size_t, const RBNode<T, V>&>
+RBNode<T, V>::get_nodes_at_level(size_t lvl) {
+    std::unordered_map<size_t, const RBNode<T, V>&> ns;
 
     _get_nodes_at_level(lvl, ns, Path{});
 
     return ns;
 }
 
-template<typename T>
-void RBNode<T>::_get_nodes_at_level(
-    size_t lvl, std::unordered_map<size_t, const RBNode<T>&>& ns, Path sp) {
+template<typename T, typename V>
+void RBNode<T, V>::_get_nodes_at_level(
+    size_t lvl, std::unordered_map<size_t, const RBNode<T, V>&>& ns, Path sp) {
     if (lvl == 0) {
         ns.insert({ sp.p_, std::as_const(*this) });
         return;
     }
 
-    if (left)
-        left->_get_nodes_at_level(lvl - 1, ns, Path::down_left(sp, color));
+    if (left())
+        left()->_get_nodes_at_level(lvl - 1, ns, Path::down_left(sp, color()));
 
     if (right)
-        right->_get_nodes_at_level(lvl - 1, ns, Path::down_right(sp, color));
+        right->_get_nodes_at_level(lvl - 1, ns, Path::down_right(sp, color()));
 }
 
-template<typename T>
-std::string RBNode<T>::format_level(size_t lvl) {
+template<typename T, typename V>
+std::string RBNode<T, V>::format_level(size_t lvl) {
     static const std::string red = "\033[1;31m";
     static const std::string reset = "\033[0m";
 
@@ -503,7 +893,7 @@ std::string RBNode<T>::format_level(size_t lvl) {
         const auto& pn = ns.find(i);
         if (pn != ns.end()) {
             const auto& n = pn->second;
-            if (n.color == RED) os << red << n.key << reset << ' ';
+            if (n.color() == RED) os << red << n.key << reset << ' ';
             else os << n.key << ' ';
         } else {
             os << "- ";
@@ -513,10 +903,10 @@ std::string RBNode<T>::format_level(size_t lvl) {
     return os.str();
 }
 
-template<typename T>
-std::unordered_map<Path, const RBNode<T>&>
-RBTree<T>::collect_all_leaves() const {
-    std::unordered_map<Path, const RBNode<T>&> all_leaves;
+template<typename T, typename V>
+std::unordered_map<Path, const RBNode<T, V>&>
+RBTree<T, V>::collect_all_leaves() const {
+    std::unordered_map<Path, const RBNode<T, V>&> all_leaves;
 
     if (!root)
         return all_leaves;
@@ -524,36 +914,38 @@ RBTree<T>::collect_all_leaves() const {
     return root->collect_all_leaves();
 }
 
-template<typename T>
-std::unordered_map<Path, const RBNode<T>&>
-RBNode<T>::collect_all_leaves() {
-    std::unordered_map<Path, const RBNode<T>&> all_leaves;
+template<typename T, typename V>
+std::unordered_map<Path, const RBNode<T, V>&>
+RBNode<T, V>::collect_all_leaves() {
+    std::unordered_map<Path, const RBNode<T, V>&> all_leaves;
 
     _collect_all_leaves(all_leaves, Path {});
 
     return all_leaves;
 }
 
-template<typename T>
+template<typename T, typename V>
 void
-RBNode<T>::_collect_all_leaves(std::unordered_map<Path,const RBNode<T>&>& ls,
+RBNode<T, V>::_collect_all_leaves(std::unordered_map<Path,const RBNode<T, V>&>& ls,
                                Path p) {
     if (is_leaf())
         ls.insert({ p, std::as_const(*this) });
 
-    if (left)
-        left->_collect_all_leaves(ls, Path::down_left(p, left->color));
+    if (left())
+        left()->_collect_all_leaves(ls, Path::down_left(p, left()->color()));
 
     if (right)
-        right->_collect_all_leaves(ls, Path::down_right(p, right->color));
+        right->_collect_all_leaves(ls, Path::down_right(p, right->color()));
 }
 
-template<typename T>
-RBNode<T>::RBNode(const T& t)
-    : key(t), color(RED), left(nullptr), right(nullptr) {}
+template<typename T, typename V>
+template <typename... Args>
+RBNode<T, V>::RBNode(const T& t, Args&&... args)
+    : RBValue<V>(std::forward<Args>(args)...), key(t), right(nullptr), size(1),
+      left_color(RED) {}
 
-template<typename T>
-std::ostream& operator<<(std::ostream& os, const RBTree<T>& rbtree) {
+template<typename T, typename V>
+std::ostream& operator<<(std::ostream& os, const RBTree<T, V>& rbtree) {
 
     if (!rbtree.root)
         return os;
@@ -565,8 +957,8 @@ std::ostream& operator<<(std::ostream& os, const RBTree<T>& rbtree) {
     return os;
 }
 
-template<typename T>
-std::ostream& operator<<(std::ostream& os, const RBNode<T>& rbnode) {
+template<typename T, typename V>
+std::ostream& operator<<(std::ostream& os, const RBNode<T, V>& rbnode) {
     auto max_depth = rbnode.get_max_depth();
     for (auto i = 0; i < max_depth; i++)
         os << rbnode.format_level(i) << '\n';
@@ -574,8 +966,8 @@ std::ostream& operator<<(std::ostream& os, const RBNode<T>& rbnode) {
     return os;
 }
 
-template <typename T>
-std::string RBTree<T>::format_graphviz() {
+template <typename T, typename V>
+std::string RBTree<T, V>::format_graphviz() {
     std::ostringstream os;
     if(!root) {
         os << "None\n";
@@ -589,17 +981,17 @@ std::string RBTree<T>::format_graphviz() {
     return os.str();
 }
 
-template <typename T>
-std::string RBNode<T>::format_graphviz() {
+template <typename T, typename V>
+std::string RBNode<T, V>::format_graphviz() {
     std::ostringstream os;
 
-    if(left) {
-        os << '\t' << key << " -- " << left->key;
-        if(is_red(left))
+    if(left()) {
+        os << '\t' << key << " -- " << left()->key;
+        if(is_red(left()))
             os << "[color=red,penwidth=3.0]";
         else
             os << "[penwidth=3.0]";
-        os << ";\n" << left->format_graphviz();
+        os << ";\n" << left()->format_graphviz();
     } else {
         os << "\tnull" << null_count << "[shape=point];\n"
            << "\t" << key << " -- " << "null" << null_count++ << ";\n";
@@ -620,4 +1012,60 @@ std::string RBNode<T>::format_graphviz() {
     return os.str();
 }
 
+/*
+ * Sorted multiset on top of the map mode: every distinct key is stored
+ * once, with the number of copies as its value, so adding or dropping a
+ * copy of a key already there is one descent. Only removing the last
+ * copy takes a second pass, to unlink the node.
+ */
+template<typename T>
+struct RBMultiset {
+    RBTree<T, size_t> tree;
+
+    /* Add one copy of t; returns how many there are now */
+    size_t insert(const T& t) {
+        size_t* c = tree.emplace(t, 0).first;
+        total++;
+        return ++*c;
+    }
+
+    /* Remove one copy of t; returns false if there was none */
+    bool remove(const T& t) {
+        size_t* c = tree.find(t);
+        if (!c)
+            return false;
+        if (--*c == 0)
+            tree.remove(t);
+        total--;
+        return true;
+    }
+
+    /* Remove every copy of t; returns how many there were */
+    size_t remove_all(const T& t) {
+        size_t* c = tree.find(t);
+        if (!c)
+            return 0;
+        size_t n = *c;
+        tree.remove(t);
+        total -= n;
+        return n;
+    }
+
+    size_t count(const T& t) {
+        size_t* c = tree.find(t);
+        return c ? *c : 0;
+    }
+
+    bool contains(const T& t) { return tree.contains(t); }
+
+    /* Number of copies of all keys */
+    size_t size() const { return total; }
+
+    const std::optional<T> leftmost_key() { return tree.leftmost_key(); }
+    const std::optional<T> rightmost_key() { return tree.rightmost_key(); }
+
+private:
+    size_t total = 0;
+};
+
 #endif // __RBTREE_H_
@@ -0,0 +1,248 @@
+#ifndef __ROBIN_HOOD_TABLE_H_
+#define __ROBIN_HOOD_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "hash_slot.hpp"
+#include "hash_funcs.hpp"
+
+#define ROBIN_HOOD_INITIAL_TABLE_SIZE 64
+
+/* Displacements stay short under Robin Hood, so the table runs fuller
+ * than HashTable before it grows. */
+#define ROBIN_HOOD_MAX_LOAD_FACTOR 0.875
+
+/* Stored distance meaning "this far or further; recompute from the hash" */
+#define ROBIN_HOOD_DIST_SATURATED UINT16_MAX
+
+/*
+ * Linear probing with Robin Hood displacement.
+ *
+ * Every slot records its distance from its home slot. An insert takes
+ * the slot of any entry that sits closer to home than the one being
+ * inserted, then carries the evicted entry further down the chain. As a
+ * result, distances along a chain never drop by more than one per slot,
+ * which gives two properties:
+ *
+ *  - a lookup can stop as soon as it meets an entry closer to home than
+ *    its own probe distance, since the key would have taken that slot;
+ *  - a delete shifts the rest of the cluster back by one slot instead of
+ *    leaving a tombstone.
+ *
+ * get/put/remove return the probe count (distance + 1), or -1 on
+ * failure, like HashTable. Distances are kept as 16 bits in HashSlot. A
+ * distance that does not fit is stored as ROBIN_HOOD_DIST_SATURATED and
+ * worked out again from the key's hash when read, so clusters of any
+ * length stay correct and only pay for the hash once they get that long.
+ */
+template <typename K, typename V, typename Hash = VirtualHash>
+class RobinHoodHashTable {
+public:
+    RobinHoodHashTable(Hash hash_func = Hash());
+    ~RobinHoodHashTable();
+    int get(const K &key, V &value);
+    int put(const K &key, const V &value);
+    int remove(const K &key);
+    size_t get_table_size();
+    size_t get_size();
+    double get_load_factor();
+
+    /* Element i is the number of live entries whose probe count is i + 1 */
+    std::vector<size_t> get_probe_histogram();
+
+private:
+    Hash hash_func;
+    size_t table_size;
+    size_t size;
+    HashSlot<K, V> *table;
+
+    unsigned long get_pos(const K &key);
+    unsigned long get_next_pos(unsigned long pos);
+    size_t get_dist(unsigned long pos);
+    void set_dist(unsigned long pos, size_t dist);
+    bool find_slot(const K &key, unsigned long &pos, size_t &dist);
+    void place(unsigned long pos, size_t dist, K key, V value);
+    void rehash(size_t new_table_size);
+
+    // disallow copy and assignment
+    RobinHoodHashTable(const RobinHoodHashTable &);
+    RobinHoodHashTable & operator=(const RobinHoodHashTable &);
+};
+
+template <typename K, typename V, typename Hash>
+RobinHoodHashTable<K, V, Hash>::RobinHoodHashTable(Hash hash_func)
+    : hash_func(hash_func), table_size(ROBIN_HOOD_INITIAL_TABLE_SIZE), size(0) {
+    table = new HashSlot<K, V>[table_size];
+}
+
+template <typename K, typename V, typename Hash>
+RobinHoodHashTable<K, V, Hash>::~RobinHoodHashTable() {
+    delete[] table;
+}
+
+template <typename K, typename V, typename Hash>
+unsigned long RobinHoodHashTable<K, V, Hash>::get_pos(const K &key) {
+    return hash_func(key) & (table_size - 1);
+}
+
+template <typename K, typename V, typename Hash>
+unsigned long RobinHoodHashTable<K, V, Hash>::get_next_pos(unsigned long pos) {
+    return (pos + 1) & (table_size - 1);
+}
+
+/* Distance of the entry at `pos' from its home slot */
+template <typename K, typename V, typename Hash>
+size_t RobinHoodHashTable<K, V, Hash>::get_dist(unsigned long pos) {
+    size_t dist = table[pos].get_dist();
+    if (dist == ROBIN_HOOD_DIST_SATURATED) {
+        dist = (pos - get_pos(table[pos].get_key())) & (table_size - 1);
+    }
+    return dist;
+}
+
+template <typename K, typename V, typename Hash>
+void RobinHoodHashTable<K, V, Hash>::set_dist(unsigned long pos, size_t dist) {
+    table[pos].set_dist(dist < ROBIN_HOOD_DIST_SATURATED ? dist : ROBIN_HOOD_DIST_SATURATED);
+}
+
+/*
+ * Walk the chain of `key' until it is found or can no longer be ahead.
+ * On a miss, `pos' and `dist' name the slot the key would take.
+ */
+template <typename K, typename V, typename Hash>
+bool RobinHoodHashTable<K, V, Hash>::find_slot(const K &key, unsigned long &pos,
+                                         size_t &dist) {
+    pos = get_pos(key);
+    dist = 0;
+    while (!table[pos].is_empty() && get_dist(pos) >= dist) {
+        if (get_dist(pos) == dist && table[pos].get_key() == key) {
+            return true;
+        }
+        pos = get_next_pos(pos);
+        dist++;
+    }
+    return false;
+}
+
+/* Put (key, value) at `pos', `dist' slots from its home, and push
+ * whatever it displaces further down the chain. */
+template <typename K, typename V, typename Hash>
+void RobinHoodHashTable<K, V, Hash>::place(unsigned long pos, size_t dist,
+                                     K key, V value) {
+    while (!table[pos].is_empty()) {
+        size_t evicted_dist = get_dist(pos);
+        if (evicted_dist < dist) {
+            std::swap(key, table[pos].get_key());
+            std::swap(value, table[pos].get_value());
+            set_dist(pos, dist);
+            dist = evicted_dist;
+        }
+        pos = get_next_pos(pos);
+        dist++;
+    }
+    table[pos].set_key_value(std::move(key), std::move(value));
+    set_dist(pos, dist);
+}
+
+template <typename K, typename V, typename Hash>
+void RobinHoodHashTable<K, V, Hash>::rehash(size_t new_table_size) {
+    HashSlot<K, V> *old_table = table;
+    size_t old_table_size = table_size;
+
+    table_size = new_table_size;
+    table = new HashSlot<K, V>[table_size];
+    for (size_t i = 0; i < old_table_size; i++) {
+        if (!old_table[i].is_empty()) {
+            unsigned long pos = get_pos(old_table[i].get_key());
+            place(pos, 0, std::move(old_table[i].get_key()),
+                  std::move(old_table[i].get_value()));
+        }
+    }
+    delete[] old_table;
+}
+
+template <typename K, typename V, typename Hash>
+int RobinHoodHashTable<K, V, Hash>::get(const K &key, V &value) {
+    unsigned long pos;
+    size_t dist;
+    if (!find_slot(key, pos, dist)) {
+        return -1;
+    }
+    value = table[pos].get_value();
+    return dist + 1;
+}
+
+template <typename K, typename V, typename Hash>
+int RobinHoodHashTable<K, V, Hash>::put(const K &key, const V &value) {
+    unsigned long pos;
+    size_t dist;
+    if (find_slot(key, pos, dist)) {
+        return -1;
+    }
+    place(pos, dist, key, value);
+    size++;
+    if (size > table_size * ROBIN_HOOD_MAX_LOAD_FACTOR) {
+        rehash(table_size * 2);
+    }
+    return dist + 1;
+}
+
+template <typename K, typename V, typename Hash>
+int RobinHoodHashTable<K, V, Hash>::remove(const K &key) {
+    unsigned long pos;
+    size_t dist;
+    if (!find_slot(key, pos, dist)) {
+        return -1;
+    }
+
+    /* Backward-shift deletion: pull each following entry one slot closer
+     * to home until reaching an empty slot or an entry already at home. */
+    unsigned long next = get_next_pos(pos);
+    while (!table[next].is_empty() && table[next].get_dist() > 0) {
+        size_t next_dist = get_dist(next);
+        table[pos].set_key_value(std::move(table[next].get_key()),
+                                 std::move(table[next].get_value()));
+        set_dist(pos, next_dist - 1);
+        pos = next;
+        next = get_next_pos(next);
+    }
+    table[pos].set_empty();
+    size--;
+    return dist + 1;
+}
+
+template <typename K, typename V, typename Hash>
+std::vector<size_t> RobinHoodHashTable<K, V, Hash>::get_probe_histogram() {
+    std::vector<size_t> histogram;
+    for (size_t i = 0; i < table_size; i++) {
+        if (table[i].is_empty()) {
+            continue;
+        }
+        size_t dist = get_dist(i);
+        if (histogram.size() <= dist) {
+            histogram.resize(dist + 1);
+        }
+        histogram[dist]++;
+    }
+    return histogram;
+}
+
+template <typename K, typename V, typename Hash>
+size_t RobinHoodHashTable<K, V, Hash>::get_table_size() {
+    return table_size;
+}
+
+template <typename K, typename V, typename Hash>
+size_t RobinHoodHashTable<K, V, Hash>::get_size() {
+    return size;
+}
+
+template <typename K, typename V, typename Hash>
+double RobinHoodHashTable<K, V, Hash>::get_load_factor() {
+    return (double)size/table_size;
+}
+
+#endif // __ROBIN_HOOD_TABLE_H_
@@ -0,0 +1,222 @@
+#ifndef __SHARDED_HASH_TABLE_H_
+#define __SHARDED_HASH_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "hash_table.hpp"
+
+#define SHARDED_DEFAULT_SHARDS 16
+
+/*
+ * How a ShardedHashTable is accessed.
+ *
+ * LOCKED: any thread may call get/put/remove; each call takes the mutex
+ * of the key's shard only.
+ *
+ * SHARED_NOTHING: every shard has one owner thread, and only that thread
+ * touches it. The caller routes keys to their owners with shard_of(), so
+ * no locks are taken and no cache line is ever shared between threads.
+ */
+enum class ShardMode { LOCKED, SHARED_NOTHING };
+
+/*
+ * Front-end that splits keys over independent LinearProbeHashTable
+ * shards, picked by the high bits of the remixed hash (the low bits
+ * still pick the slot inside the shard). Shards never share memory, so
+ * unlike ConcurrentHashTable nothing at all is shared between threads
+ * working on different shards.
+ *
+ * NUMA placement relies on the kernel's first-touch policy: a page lands
+ * on the node of the thread that first writes it. A shard's slot array
+ * is written by whoever builds it, so an owner thread calls
+ * attach_owner() for each of its shards, which optionally pins the
+ * thread to a CPU and rebuilds the (still empty) shard from there. Every
+ * later resize is done by the thread inserting, i.e. the owner, so the
+ * shard stays on the owner's node as it grows.
+ *
+ * get/put/remove return the probe count inside the shard, or -1.
+ */
+template <typename K, typename V, typename Hash = VirtualHash,
+          typename Layout = SlotArray<K, V> >
+class ShardedHashTable {
+public:
+    typedef LinearProbeHashTable<K, V, Hash, Layout> Shard;
+
+    ShardedHashTable(Hash hash_func = Hash(),
+                     size_t num_shards = SHARDED_DEFAULT_SHARDS,
+                     ShardMode mode = ShardMode::LOCKED,
+                     ResizeMode resize_mode = ResizeMode::ALL_AT_ONCE);
+    ~ShardedHashTable();
+    int get(const K &key, V &value);
+    int put(const K &key, const V &value);
+    int remove(const K &key);
+
+    size_t get_num_shards();
+    size_t shard_of(const K &key);
+
+    /* Direct access for the owner of shard `i' in SHARED_NOTHING mode */
+    Shard &get_shard(size_t i);
+
+    /* Called by the thread that will own shard `i'. Pins the calling
+     * thread to `cpu' unless it is negative, and reallocates the shard,
+     * which must still be empty, so that its memory is local to that
+     * thread. Returns false if pinning failed or the shard is not empty. */
+    bool attach_owner(size_t i, int cpu = -1);
+
+    /* Pin the calling thread to `cpu' */
+    static bool pin_current_thread(int cpu);
+
+    size_t get_table_size();
+    size_t get_size();
+    double get_load_factor();
+
+private:
+    struct alignas(64) ShardSlot {
+        std::mutex lock;
+        Shard *table;
+    };
+
+    Hash hash_func;
+    ResizeMode resize_mode;
+    ShardMode mode;
+    size_t num_shards;
+    unsigned shard_shift;
+    ShardSlot *shards;
+
+    // disallow copy and assignment
+    ShardedHashTable(const ShardedHashTable &);
+    ShardedHashTable & operator=(const ShardedHashTable &);
+};
+
+template <typename K, typename V, typename Hash, typename Layout>
+ShardedHashTable<K, V, Hash, Layout>::ShardedHashTable(Hash hash_func, size_t num_shards,
+                                                       ShardMode mode,
+                                                       ResizeMode resize_mode)
+    : hash_func(hash_func), resize_mode(resize_mode), mode(mode),
+      num_shards(1), shard_shift(64) {
+    while (this->num_shards < num_shards) {
+        this->num_shards *= 2;
+        shard_shift--;
+    }
+    shards = new ShardSlot[this->num_shards];
+    for (size_t i = 0; i < this->num_shards; i++) {
+        shards[i].table = new Shard(hash_func, resize_mode);
+    }
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+ShardedHashTable<K, V, Hash, Layout>::~ShardedHashTable() {
+    for (size_t i = 0; i < num_shards; i++) {
+        delete shards[i].table;
+    }
+    delete[] shards;
+}
+
+/* Same routing as ConcurrentHashTable::get_segment */
+template <typename K, typename V, typename Hash, typename Layout>
+size_t ShardedHashTable<K, V, Hash, Layout>::shard_of(const K &key) {
+    if (num_shards == 1) {
+        return 0;
+    }
+    return ((uint64_t)hash_func(key) * 0x9E3779B97F4A7C15ULL) >> shard_shift;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+int ShardedHashTable<K, V, Hash, Layout>::get(const K &key, V &value) {
+    ShardSlot &s = shards[shard_of(key)];
+    if (mode == ShardMode::SHARED_NOTHING) {
+        return s.table->get(key, value);
+    }
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.table->get(key, value);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+int ShardedHashTable<K, V, Hash, Layout>::put(const K &key, const V &value) {
+    ShardSlot &s = shards[shard_of(key)];
+    if (mode == ShardMode::SHARED_NOTHING) {
+        return s.table->put(key, value);
+    }
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.table->put(key, value);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+int ShardedHashTable<K, V, Hash, Layout>::remove(const K &key) {
+    ShardSlot &s = shards[shard_of(key)];
+    if (mode == ShardMode::SHARED_NOTHING) {
+        return s.table->remove(key);
+    }
+    std::lock_guard<std::mutex> guard(s.lock);
+    return s.table->remove(key);
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+size_t ShardedHashTable<K, V, Hash, Layout>::get_num_shards() {
+    return num_shards;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+typename ShardedHashTable<K, V, Hash, Layout>::Shard &
+ShardedHashTable<K, V, Hash, Layout>::get_shard(size_t i) {
+    return *shards[i].table;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+bool ShardedHashTable<K, V, Hash, Layout>::pin_current_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+bool ShardedHashTable<K, V, Hash, Layout>::attach_owner(size_t i, int cpu) {
+    if (cpu >= 0 && !pin_current_thread(cpu)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(shards[i].lock);
+    if (shards[i].table->get_size() != 0) {
+        return false;
+    }
+    Shard *local = new Shard(hash_func, resize_mode);
+    delete shards[i].table;
+    shards[i].table = local;
+    return true;
+}
+
+/* The totals below lock one shard at a time, so under concurrent writes
+ * they are not a consistent snapshot of the whole table. In
+ * SHARED_NOTHING mode the owners do not take the locks, so call them
+ * only while the owners are idle. */
+template <typename K, typename V, typename Hash, typename Layout>
+size_t ShardedHashTable<K, V, Hash, Layout>::get_table_size() {
+    size_t total = 0;
+    for (size_t i = 0; i < num_shards; i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        total += shards[i].table->get_table_size();
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+size_t ShardedHashTable<K, V, Hash, Layout>::get_size() {
+    size_t total = 0;
+    for (size_t i = 0; i < num_shards; i++) {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        total += shards[i].table->get_size();
+    }
+    return total;
+}
+
+template <typename K, typename V, typename Hash, typename Layout>
+double ShardedHashTable<K, V, Hash, Layout>::get_load_factor() {
+    return (double)get_size()/get_table_size();
+}
+
+#endif // __SHARDED_HASH_TABLE_H_
@@ -0,0 +1,296 @@
+#ifndef __SWISS_TABLE_H_
+#define __SWISS_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hash_funcs.hpp"
+
+#define SWISS_INITIAL_TABLE_SIZE 64
+#define SWISS_GROUP_WIDTH 16
+
+/* Swiss tables stay fast well past the 0.5 limit of HashTable, since a
+ * probe only reads one control byte per slot. */
+#define SWISS_MAX_LOAD_FACTOR 0.875
+
+/*
+ * Open-addressing table in the style of Abseil's flat_hash_map.
+ *
+ * Next to the slot array there is one control byte per slot. A full slot
+ * stores the low 7 bits of the key's hash (h2) there, so the sign bit of
+ * a control byte tells free slots from full ones. Slots are probed in
+ * groups of SWISS_GROUP_WIDTH: one SSE2 compare finds every slot in a
+ * group whose h2 matches, and only those candidates get a full key
+ * compare. Groups are visited in triangular order, which covers all of
+ * them since the group count is a power of two.
+ *
+ * get/put/remove return the number of groups probed, or -1 on failure,
+ * mirroring HashTable.
+ */
+template <typename K, typename V, typename Hash = VirtualHash>
+class SwissHashTable {
+public:
+    SwissHashTable(Hash hash_func = Hash());
+    ~SwissHashTable();
+    int get(const K &key, V &value);
+    int put(const K &key, const V &value);
+    int remove(const K &key);
+    size_t get_table_size();
+    size_t get_size();
+    double get_load_factor();
+
+private:
+    static constexpr int8_t CTRL_EMPTY = -128;
+    static constexpr int8_t CTRL_DELETED = -2;
+
+    Hash hash_func;
+    size_t table_size;
+    size_t size;
+    size_t tombstones;
+    int8_t *ctrl;
+    std::pair<K, V> *slots;
+
+    unsigned long get_hash(const K &key);
+    static uint32_t match_byte(const int8_t *group, int8_t h2);
+    static uint32_t match_empty(const int8_t *group);
+    static uint32_t match_free(const int8_t *group);
+    bool find_slot(const K &key, unsigned long hash, size_t &pos, int &probe);
+    void rehash(size_t new_table_size);
+
+    // disallow copy and assignment
+    SwissHashTable(const SwissHashTable &);
+    SwissHashTable & operator=(const SwissHashTable &);
+};
+
+template <typename K, typename V, typename Hash>
+SwissHashTable<K, V, Hash>::SwissHashTable(Hash hash_func)
+    : hash_func(hash_func), table_size(SWISS_INITIAL_TABLE_SIZE),
+      size(0), tombstones(0) {
+    ctrl = new int8_t[table_size];
+    std::memset(ctrl, CTRL_EMPTY, table_size);
+    slots = new std::pair<K, V>[table_size];
+}
+
+template <typename K, typename V, typename Hash>
+SwissHashTable<K, V, Hash>::~SwissHashTable() {
+    delete[] ctrl;
+    delete[] slots;
+}
+
+/* Hash policies may be as weak as the identity function, and both the
+ * group index and h2 need well-mixed bits. */
+template <typename K, typename V, typename Hash>
+unsigned long SwissHashTable<K, V, Hash>::get_hash(const K &key) {
+    uint64_t h = hash_func(key);
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+#if defined(__SSE2__)
+
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_byte(const int8_t *group, int8_t h2) {
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(h2)));
+}
+
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_empty(const int8_t *group) {
+    return match_byte(group, CTRL_EMPTY);
+}
+
+/* Empty and deleted are the only control bytes with the sign bit set */
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_free(const int8_t *group) {
+    __m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return _mm_movemask_epi8(g);
+}
+
+#else
+
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_byte(const int8_t *group, int8_t h2) {
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (group[i] == h2) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_empty(const int8_t *group) {
+    return match_byte(group, CTRL_EMPTY);
+}
+
+template <typename K, typename V, typename Hash>
+uint32_t SwissHashTable<K, V, Hash>::match_free(const int8_t *group) {
+    uint32_t mask = 0;
+    for (int i = 0; i < SWISS_GROUP_WIDTH; i++) {
+        if (group[i] < 0) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+#endif
+
+/*
+ * Walk the groups of `key' once. On a hit `pos' is the key's slot. On a
+ * miss `pos' is the first free slot seen on the way (deleted slots are
+ * reused), and `probe' is the number of groups walked up to that slot.
+ */
+template <typename K, typename V, typename Hash>
+bool SwissHashTable<K, V, Hash>::find_slot(const K &key, unsigned long hash,
+                                     size_t &pos, int &probe) {
+    size_t group_mask = table_size / SWISS_GROUP_WIDTH - 1;
+    size_t group = (hash >> 7) & group_mask;
+    int8_t h2 = hash & 0x7f;
+    int free_probe = -1;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+        const int8_t *g = ctrl + group * SWISS_GROUP_WIDTH;
+
+        for (uint32_t m = match_byte(g, h2); m; m &= m - 1) {
+            size_t i = group * SWISS_GROUP_WIDTH + __builtin_ctz(m);
+            if (slots[i].first == key) {
+                pos = i;
+                probe = step;
+                return true;
+            }
+        }
+
+        if (free_probe == -1) {
+            uint32_t m = match_free(g);
+            if (m) {
+                pos = group * SWISS_GROUP_WIDTH + __builtin_ctz(m);
+                free_probe = step;
+            }
+        }
+        if (match_empty(g)) {
+            break;
+        }
+        group = (group + step) & group_mask;
+    }
+
+    probe = free_probe;
+    return false;
+}
+
+template <typename K, typename V, typename Hash>
+void SwissHashTable<K, V, Hash>::rehash(size_t new_table_size) {
+    int8_t *old_ctrl = ctrl;
+    std::pair<K, V> *old_slots = slots;
+    size_t old_table_size = table_size;
+
+    table_size = new_table_size;
+    ctrl = new int8_t[table_size];
+    std::memset(ctrl, CTRL_EMPTY, table_size);
+    slots = new std::pair<K, V>[table_size];
+
+    for (size_t i = 0; i < old_table_size; i++) {
+        if (old_ctrl[i] < 0) {
+            continue;
+        }
+        unsigned long hash = get_hash(old_slots[i].first);
+        size_t pos;
+        int probe;
+        find_slot(old_slots[i].first, hash, pos, probe);
+        ctrl[pos] = hash & 0x7f;
+        slots[pos] = std::move(old_slots[i]);
+    }
+    tombstones = 0;
+    delete[] old_ctrl;
+    delete[] old_slots;
+}
+
+template <typename K, typename V, typename Hash>
+int SwissHashTable<K, V, Hash>::get(const K &key, V &value) {
+    size_t pos;
+    int probe;
+    if (!find_slot(key, get_hash(key), pos, probe)) {
+        return -1;
+    }
+    value = slots[pos].second;
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+int SwissHashTable<K, V, Hash>::put(const K &key, const V &value) {
+    unsigned long hash = get_hash(key);
+    size_t pos;
+    int probe;
+    if (find_slot(key, hash, pos, probe)) {
+        return -1;
+    }
+
+    /* Out of room: grow if live entries fill the table, otherwise just
+     * reclaim the tombstones. Either way the slot has to be found again. */
+    if (probe == -1 || (ctrl[pos] == CTRL_EMPTY &&
+        size + tombstones + 1 > table_size * SWISS_MAX_LOAD_FACTOR)) {
+        if (size + 1 > table_size * SWISS_MAX_LOAD_FACTOR / 2) {
+            rehash(table_size * 2);
+        }
+        else {
+            rehash(table_size);
+        }
+        find_slot(key, hash, pos, probe);
+    }
+
+    if (ctrl[pos] == CTRL_DELETED) {
+        tombstones--;
+    }
+    ctrl[pos] = hash & 0x7f;
+    slots[pos].first = key;
+    slots[pos].second = value;
+    size++;
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+int SwissHashTable<K, V, Hash>::remove(const K &key) {
+    size_t pos;
+    int probe;
+    if (!find_slot(key, get_hash(key), pos, probe)) {
+        return -1;
+    }
+
+    /* A lookup only moves past a group that has no empty slot, so a group
+     * that still has one can take an empty marker without breaking any
+     * probe chain. */
+    const int8_t *g = ctrl + pos / SWISS_GROUP_WIDTH * SWISS_GROUP_WIDTH;
+    if (match_empty(g)) {
+        ctrl[pos] = CTRL_EMPTY;
+    }
+    else {
+        ctrl[pos] = CTRL_DELETED;
+        tombstones++;
+    }
+    size--;
+    return probe;
+}
+
+template <typename K, typename V, typename Hash>
+size_t SwissHashTable<K, V, Hash>::get_table_size() {
+    return table_size;
+}
+
+template <typename K, typename V, typename Hash>
+size_t SwissHashTable<K, V, Hash>::get_size() {
+    return size;
+}
+
+template <typename K, typename V, typename Hash>
+double SwissHashTable<K, V, Hash>::get_load_factor() {
+    return (double)size/table_size;
+}
+
+#endif // __SWISS_TABLE_H_